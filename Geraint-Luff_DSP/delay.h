@@ -342,6 +342,109 @@ namespace delay {
 		}
 	};
 	
+	/** @brief Multi-channel delay buffer with interleaved frames
+
+		Each position holds all channels contiguously, padded out to a 32- or 64-byte aligned frame.  Writing a frame is one aligned store, reading the same delay on every channel is one contiguous load, and reading a separate delay per channel is a gather from nearby frames (instead of `MultiBuffer`'s separate masked lookup in each channel's region).
+
+		The number of channels is fixed at compile-time.  Indexing matches `Buffer`: the head moves with `++buffer`, and `buffer.frame(-10)` is the frame from 10 samples ago.
+
+		The frames live in a `Storage<Frame>`, which needs `resize()`, `assign()`, `size()` and `operator[]` like `std::vector` (the default).  A storage that hands out lazily-zeroed memory makes `resize()` and `reset()` cheap for long buffers.
+	*/
+	template<typename Sample, int channels, template<class> class Storage=std::vector>
+	class InterleavedMultiBuffer {
+		static constexpr int frameBytes = int(channels*sizeof(Sample));
+	public:
+		static constexpr int frameAlignment = (frameBytes <= 32) ? 32 : 64;
+		static constexpr int frameSize = int(((frameBytes + frameAlignment - 1)/frameAlignment)*frameAlignment/sizeof(Sample));
+
+		struct alignas(frameAlignment) Frame {
+			std::array<Sample, frameSize> samples;
+
+			Sample & operator[](int channel) {
+				return samples[channel];
+			}
+			const Sample & operator[](int channel) const {
+				return samples[channel];
+			}
+		};
+	private:
+		unsigned bufferIndex = 0;
+		unsigned bufferMask = 0;
+		Storage<Frame> frames;
+	public:
+		InterleavedMultiBuffer(int minCapacity=0) {
+			resize(minCapacity);
+		}
+		// We shouldn't accidentally copy a delay buffer
+		InterleavedMultiBuffer(const InterleavedMultiBuffer &other) = delete;
+		InterleavedMultiBuffer & operator =(const InterleavedMultiBuffer &other) = delete;
+		// But moving one is fine
+		InterleavedMultiBuffer(InterleavedMultiBuffer &&other) = default;
+		InterleavedMultiBuffer & operator =(InterleavedMultiBuffer &&other) = default;
+
+		void resize(int minCapacity, Sample value=Sample()) {
+			int bufferLength = 1;
+			while (bufferLength < minCapacity) bufferLength *= 2;
+			frames.resize(bufferLength);
+			bufferMask = unsigned(bufferLength - 1);
+			bufferIndex = 0;
+			reset(value);
+		}
+		void reset(Sample value=Sample()) {
+			Frame fill;
+			fill.samples.fill(value);
+			frames.assign(frames.size(), fill);
+		}
+
+		/// The frame `offset` samples from the head (negative for the past)
+		Frame & frame(int offset) {
+			return frames[(bufferIndex + (unsigned)offset)&bufferMask];
+		}
+		const Frame & frame(int offset) const {
+			return frames[(bufferIndex + (unsigned)offset)&bufferMask];
+		}
+
+		/// Moves the head on one sample, and writes all channels there
+		template<class Data>
+		void write(const Data &data) {
+			++bufferIndex;
+			Frame &f = frame(0);
+			for (int c = 0; c < channels; ++c) {
+				f[c] = data[c];
+			}
+		}
+		/// Reads the same delay (in whole samples) on every channel
+		template<class Output>
+		void read(int delaySamples, Output &output) const {
+			const Frame &f = frame(-delaySamples);
+			for (int c = 0; c < channels; ++c) {
+				output[c] = f[c];
+			}
+		}
+		/// Reads `offsets[g]` samples into the past on each group `g` of `groupSize` adjacent channels, so each group is a contiguous read
+		template<int groupSize, class Offsets, class Output>
+		void gatherGroups(const Offsets &offsets, Output &output) const {
+			static_assert(channels%groupSize == 0, "groups must divide the channels");
+			const Sample *base = frames[0].samples.data();
+			for (int g = 0; g < channels/groupSize; ++g) {
+				unsigned index = (bufferIndex - (unsigned)offsets[g])&bufferMask;
+				const Sample *group = base + index*frameSize + g*groupSize;
+				for (int i = 0; i < groupSize; ++i) {
+					output[g*groupSize + i] = group[i];
+				}
+			}
+		}
+
+		InterleavedMultiBuffer & operator ++() {
+			++bufferIndex;
+			return *this;
+		}
+		InterleavedMultiBuffer & operator +=(int i) {
+			bufferIndex += (unsigned)i;
+			return *this;
+		}
+	};
+	
 	/** \defgroup Interpolators Interpolators
 		\ingroup Delay
 		@{ */
@@ -578,6 +681,33 @@ namespace delay {
 	using InterpolatorKaiserSinc4Min = InterpolatorKaiserSincN<Sample, 4, true>;
 	///  @}
 	
+	/** \defgroup MultiInterpolators Multi-channel interpolators
+		\ingroup Delay
+		@brief The interpolators above, evaluated for a whole frame of channels at once
+
+		Each channel has its own fractional position.  The input taps are gathered first into a `[tap][channel]` array (see `InterleavedMultiDelay`), so the interpolation is plain arithmetic across channels.  Only the linear one is here, as it's the only one in use.
+		@{ */
+	/// `[tap][channel]` input for the multi-channel interpolators
+	template<typename Sample, int channels, int inputLength>
+	using MultiTaps = std::array<std::array<Sample, channels>, inputLength>;
+
+	/// Multi-channel `InterpolatorLinear`
+	template<typename Sample, int channels>
+	struct MultiInterpolatorLinear {
+		static constexpr int inputLength = 2;
+		static constexpr int latency = 0;
+		using Frame = std::array<Sample, channels>;
+
+		template<class Taps, class Output>
+		void fractional(const Taps &taps, const Frame &fractional, Output &output) const {
+			for (int c = 0; c < channels; ++c) {
+				Sample a = taps[0][c], b = taps[1][c];
+				output[c] = a + fractional[c]*(b - a);
+			}
+		}
+	};
+	///  @}
+
 	/** @brief A delay-line reader which uses an external buffer
  
 		This is useful if you have multiple delay-lines reading from the same buffer.
@@ -712,6 +842,76 @@ namespace delay {
 		}
 	};
 
+	/**	@brief A multi-channel delay-line on an `InterleavedMultiBuffer`
+
+		Reads go through a multi-channel interpolator (see @ref MultiInterpolators).  Reading one delay for all channels loads whole frames, separate delays per channel are gathered.
+	*/
+	template<class Sample, int channels, class Interpolator=MultiInterpolatorLinear<Sample, channels>, template<class> class Storage=std::vector>
+	class InterleavedMultiDelay : private Interpolator {
+		using Super = Interpolator;
+		InterleavedMultiBuffer<Sample, channels, Storage> buffer;
+	public:
+		using Frame = std::array<Sample, channels>;
+		static constexpr Sample latency = Interpolator::latency;
+
+		InterleavedMultiDelay(int capacity=0) : buffer(1 + capacity + Interpolator::inputLength) {}
+		/// Pass in a configured interpolator
+		InterleavedMultiDelay(const Interpolator &interp, int capacity=0) : Super(interp), buffer(1 + capacity + Interpolator::inputLength) {}
+
+		void reset(Sample value=Sample()) {
+			buffer.reset(value);
+		}
+		void resize(int minCapacity, Sample value=Sample()) {
+			buffer.resize(minCapacity + Interpolator::inputLength, value);
+		}
+
+		/// Reads the same delay on every channel
+		template<class Output>
+		void read(Sample delaySamples, Output &output) const {
+			int startIndex = int(delaySamples);
+			Frame remainder;
+			remainder.fill(delaySamples - startIndex);
+
+			MultiTaps<Sample, channels, Interpolator::inputLength> taps;
+			for (int i = 0; i < Interpolator::inputLength; ++i) {
+				buffer.read(startIndex + i, taps[i]);
+			}
+			Super::fractional(taps, remainder, output);
+		}
+		/// Reads separate delays for each channel
+		template<class Delays, class Output>
+		void readMulti(const Delays &delaySamples, Output &output) const {
+			readGroups<1>(delaySamples, output);
+		}
+		/// Reads one delay per group of `groupSize` adjacent channels (`delaySamples[g]` is used for channels `g*groupSize` up to `(g + 1)*groupSize - 1`).  The read position is worked out once per group.
+		template<int groupSize, class Delays, class Output>
+		void readGroups(const Delays &delaySamples, Output &output) const {
+			constexpr int groups = channels/groupSize;
+			std::array<int, groups> offsets;
+			Frame remainder;
+			for (int g = 0; g < groups; ++g) {
+				offsets[g] = int(delaySamples[g]);
+				Sample fractional = delaySamples[g] - offsets[g];
+				for (int i = 0; i < groupSize; ++i) {
+					remainder[g*groupSize + i] = fractional;
+				}
+			}
+
+			MultiTaps<Sample, channels, Interpolator::inputLength> taps;
+			for (int i = 0; i < Interpolator::inputLength; ++i) {
+				buffer.template gatherGroups<groupSize>(offsets, taps[i]);
+				for (int g = 0; g < groups; ++g) ++offsets[g];
+			}
+			Super::fractional(taps, remainder, output);
+		}
+		/// Writes a frame.  Returns the same object, so that you can say `delay.write(v).readMulti(delays, out)`.
+		template<class Data>
+		InterleavedMultiDelay & write(const Data &data) {
+			buffer.write(data);
+			return *this;
+		}
+	};
+
 /** @} */
 }} // signalsmith::delay::
 #endif // include guard
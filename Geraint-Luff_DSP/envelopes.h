@@ -6,6 +6,7 @@
 #include <cmath>
 #include <random>
 #include <vector>
+#include <array>
 #include <iterator>
 
 namespace signalsmith {
@@ -117,6 +118,119 @@ namespace envelopes {
 		}
 	};
 	
+	/**	A bank of `CubicLfo`s with shared settings, stepped together.
+		The curves are the same as `CubicLfo`, but the state is kept in per-lane arrays so the common case (no lane starting a new segment) vectorises.  Lanes are randomised independently.
+
+		`.retrigger()` restarts from the seed, so the modulation repeats exactly from that point.
+	*/
+	template<int lanes>
+	class CubicLfoBank {
+		using Array = std::array<float, lanes>;
+		Array ratio, ratioStep;
+		Array valueFrom, valueTo, valueRange;
+		
+		float targetLow = 0, targetHigh = 1;
+		float targetRate = 0;
+		float rateRandom = 0.5, depthRandom = 0;
+		bool freshReset = true;
+		
+		long seed;
+		std::default_random_engine randomEngine;
+		std::uniform_real_distribution<float> randomUnit;
+		float random() {
+			return randomUnit(randomEngine);
+		}
+		float randomRate() {
+			return targetRate*exp(rateRandom*(random() - 0.5));
+		}
+		float randomTarget(float previous) {
+			float randomOffset = depthRandom*random()*(targetLow - targetHigh);
+			if (previous < (targetLow + targetHigh)*0.5f) {
+				return targetHigh + randomOffset;
+			} else {
+				return targetLow - randomOffset;
+			}
+		}
+	public:
+		CubicLfoBank() : CubicLfoBank(long(std::random_device()())) {}
+		CubicLfoBank(long seed) : seed(seed), randomUnit(0, 1) {
+			randomEngine.seed(seed);
+			reset();
+		}
+
+		/// Resets every lane, starting with random phases.
+		void reset() {
+			for (int l = 0; l < lanes; ++l) {
+				ratio[l] = random();
+				ratioStep[l] = randomRate();
+				if (random() < 0.5) {
+					valueFrom[l] = targetLow;
+					valueTo[l] = targetHigh;
+				} else {
+					valueFrom[l] = targetHigh;
+					valueTo[l] = targetLow;
+				}
+				valueRange[l] = valueTo[l] - valueFrom[l];
+			}
+			freshReset = true;
+		}
+		/// Resets to the state just after construction (same random sequence)
+		void retrigger() {
+			randomEngine.seed(seed);
+			reset();
+		}
+		/// Changes the seed (for repeatable output), and retriggers
+		void setSeed(long newSeed) {
+			seed = newSeed;
+			retrigger();
+		}
+		
+		/// Same as `CubicLfo::set()`, for all lanes
+		void set(float low, float high, float rate, float rateVariation=0, float depthVariation=0) {
+			rate *= 2; // We want to go up and down during this period
+			targetRate = rate;
+			targetLow = std::min(low, high);
+			targetHigh = std::max(low, high);
+			rateRandom = rateVariation;
+			depthRandom = std::min<float>(1, std::max<float>(0, depthVariation));
+			
+			// If we haven't called .next() yet, don't bother being smooth.
+			if (freshReset) return reset();
+
+			// Only update the current rates if they're outside our new random-variation range
+			float maxRandomRatio = exp((float)0.5*rateRandom);
+			for (int l = 0; l < lanes; ++l) {
+				if (ratioStep[l] > rate*maxRandomRatio || ratioStep[l] < rate/maxRandomRatio) {
+					ratioStep[l] = randomRate();
+				}
+			}
+		}
+		
+		/// Writes the next output sample for every lane
+		template<class Output>
+		void next(Output &&output) {
+			freshReset = false;
+			bool newSegment = false;
+			for (int l = 0; l < lanes; ++l) {
+				float r = ratio[l];
+				output[l] = r*r*(3 - 2*r)*valueRange[l] + valueFrom[l];
+				ratio[l] = r + ratioStep[l];
+				newSegment |= (ratio[l] >= 1);
+			}
+			if (!newSegment) return;
+
+			for (int l = 0; l < lanes; ++l) {
+				while (ratio[l] >= 1) {
+					ratio[l] -= 1;
+					ratioStep[l] = randomRate();
+					valueFrom[l] = valueTo[l];
+					valueTo[l] = randomTarget(valueFrom[l]);
+					valueRange[l] = valueTo[l] - valueFrom[l];
+				}
+			}
+		}
+	};
+	
 	/** Variable-width rectangular sum */
 	template<typename Sample=double>
 	class BoxSum {
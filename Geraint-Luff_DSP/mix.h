@@ -56,6 +56,33 @@ namespace mix {
 				data[i + startIndex + hSize] = (a - b);
 			}
 		}
+
+		/// Applies the matrix separately to `lanes` interleaved vectors (`data[i*lanes + lane]`), scaled so it's orthogonal.  Each butterfly handles a whole group of lanes, so it vectorises across them.
+		template<int lanes, class Data>
+		static void interleavedInPlace(Data &&data) {
+			unscaledInterleavedInPlace<lanes>(data);
+
+			Sample factor = scalingFactor();
+			for (int c = 0; c < size*lanes; ++c) {
+				data[c] *= factor;
+			}
+		}
+
+		/// Interleaved version of `unscaledInPlace()`
+		template<int lanes, int startIndex=0, class Data>
+		static void unscaledInterleavedInPlace(Data &&data) {
+			if (size <= 1) return;
+			constexpr int hSize = size/2;
+
+			Hadamard<Sample, hSize>::template unscaledInterleavedInPlace<lanes, startIndex>(data);
+			Hadamard<Sample, hSize>::template unscaledInterleavedInPlace<lanes, startIndex + hSize>(data);
+
+			for (int i = startIndex*lanes; i < (startIndex + hSize)*lanes; ++i) {
+				Sample a = data[i], b = data[i + hSize*lanes];
+				data[i] = (a + b);
+				data[i + hSize*lanes] = (a - b);
+			}
+		}
 	};
 	/// @brief Hadamard with dynamic size
 	template<typename Sample>
@@ -116,6 +143,30 @@ namespace mix {
 				data[i] += sum;
 			}
 		}
+		/// Applies the matrix separately to `lanes` interleaved vectors (`data[i*lanes + lane]`)
+		template<int lanes, class Data>
+		static void interleavedInPlace(Data &&data) {
+			if (size < 1) return;
+			const Sample factor = Sample(-2)/Sample(size ? size : 1);
+
+			std::array<Sample, lanes> sum;
+			for (int l = 0; l < lanes; ++l) {
+				sum[l] = data[l];
+			}
+			for (int i = 1; i < size; ++i) {
+				for (int l = 0; l < lanes; ++l) {
+					sum[l] += data[i*lanes + l];
+				}
+			}
+			for (int l = 0; l < lanes; ++l) {
+				sum[l] *= factor;
+			}
+			for (int i = 0; i < size; ++i) {
+				for (int l = 0; l < lanes; ++l) {
+					data[i*lanes + l] += sum[l];
+				}
+			}
+		}
 		/// @deprecated The matrix is already orthogonal, but this is here for compatibility with Hadamard
 		constexpr static Sample scalingFactor() {
 			return 1;
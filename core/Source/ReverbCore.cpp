@@ -0,0 +1,181 @@
+// Replaces operator new/delete here when built with REVERB_RT_CHECKS (RealtimeChecks.h)
+#define REVERB_RT_CHECKS_IMPLEMENTATION
+#include "ReverbCore.h"
+#include "reverb_core.h"
+#include "ReverbEngine.h"
+#include "ParameterEvents.h"
+
+#include <new>
+
+
+static_assert(static_cast<int>(ReverbCore::StereoMode::trueStereo) == static_cast<int>(StereoMode::trueStereo),
+              "ReverbCore::StereoMode must match StereoMode");
+static_assert(static_cast<int>(ReverbCore::Parameter::modDepth) == static_cast<int>(ParamId::modDepth),
+              "ReverbCore::Parameter must match ParamId");
+static_assert(REVERB_PARAM_MOD_DEPTH == static_cast<int>(ParamId::modDepth), "reverb_param must match ParamId");
+static_assert(REVERB_STEREO_MODE_TRUE_STEREO == static_cast<int>(StereoMode::trueStereo),
+              "reverb_stereo_mode must match StereoMode");
+
+
+ReverbCore::ReverbCore(const Layout &layout)
+	: engine(createReverbEngine(layout.numChannels, layout.lfeChannel, layout.ambisonicOrder,
+	                            static_cast<::StereoMode>(layout.stereoMode)))
+{
+}
+
+ReverbCore::~ReverbCore() = default;
+
+void ReverbCore::configure(double sampleRate)
+{
+	engine->configure(sampleRate);
+}
+
+void ReverbCore::setSeed(uint32_t seed)
+{
+	engine->setSeed(seed);
+}
+
+uint32_t ReverbCore::getSeed() const
+{
+	return engine->getSeed();
+}
+
+void ReverbCore::setParameter(Parameter parameter, double value)
+{
+	REVERB_RT_SCOPE();
+	switch (parameter)
+	{
+		case Parameter::size:           engine->setRoomSize(value); break;
+		case Parameter::decay:          engine->setDecay(value); break;
+		case Parameter::dry:            engine->setDry(value); break;
+		case Parameter::diffuser:       engine->setDiffusionGain(value); break;
+		case Parameter::wetReflections: engine->setEarlyReflections(value); break;
+		case Parameter::preDelay:       engine->setPreDelay(value); break;
+		case Parameter::modRate:        engine->setModulationRate(value); break;
+		case Parameter::modDepth:       engine->setModulationDepth(value); break;
+	}
+}
+
+void ReverbCore::retriggerModulation()
+{
+	REVERB_RT_SCOPE();
+	engine->retriggerModulation();
+}
+
+int ReverbCore::getNumChannels() const
+{
+	return engine->getNumChannels();
+}
+
+void ReverbCore::process(float* const* channels, int numSamples)
+{
+	REVERB_RT_SCOPE();
+	engine->process(channels, numSamples);
+}
+
+void ReverbCore::process(double* const* channels, int numSamples)
+{
+	REVERB_RT_SCOPE();
+	engine->process(channels, numSamples);
+}
+
+void ReverbCore::processInterleaved(float* data, int numSamples)
+{
+	REVERB_RT_SCOPE();
+	engine->processInterleaved(data, numSamples);
+}
+
+void ReverbCore::processInterleaved(double* data, int numSamples)
+{
+	REVERB_RT_SCOPE();
+	engine->processInterleaved(data, numSamples);
+}
+
+
+// C interface: exceptions (allocation failures) must not cross it
+
+struct reverb_core {
+	ReverbCore core;
+};
+
+reverb_core* reverb_core_create(int num_channels, int lfe_channel, int ambisonic_order, reverb_stereo_mode stereo_mode)
+{
+	if (num_channels < 1 || num_channels > ReverbEngine::maxChannels)
+		return nullptr;
+
+	ReverbCore::Layout layout;
+	layout.numChannels = num_channels;
+	layout.lfeChannel = lfe_channel;
+	layout.ambisonicOrder = ambisonic_order;
+	layout.stereoMode = static_cast<ReverbCore::StereoMode>(stereo_mode);
+
+	try
+	{
+		return new reverb_core{ ReverbCore(layout) };
+	}
+	catch (...)
+	{
+		return nullptr;
+	}
+}
+
+void reverb_core_destroy(reverb_core* reverb)
+{
+	delete reverb;
+}
+
+int reverb_core_configure(reverb_core* reverb, double sample_rate)
+{
+	if (reverb == nullptr || !(sample_rate > 0))
+		return -1;
+
+	try
+	{
+		reverb->core.configure(sample_rate);
+		return 0;
+	}
+	catch (...)
+	{
+		return -1;
+	}
+}
+
+void reverb_core_set_seed(reverb_core* reverb, uint32_t seed)
+{
+	reverb->core.setSeed(seed);
+}
+
+void reverb_core_set_parameter(reverb_core* reverb, reverb_param param, double value)
+{
+	reverb->core.setParameter(static_cast<ReverbCore::Parameter>(param), value);
+}
+
+void reverb_core_retrigger_modulation(reverb_core* reverb)
+{
+	reverb->core.retriggerModulation();
+}
+
+int reverb_core_num_channels(const reverb_core* reverb)
+{
+	return reverb->core.getNumChannels();
+}
+
+void reverb_core_process_float(reverb_core* reverb, float* const* channels, int num_samples)
+{
+	reverb->core.process(channels, num_samples);
+}
+
+void reverb_core_process_double(reverb_core* reverb, double* const* channels, int num_samples)
+{
+	reverb->core.process(channels, num_samples);
+}
+
+void reverb_core_process_interleaved_float(reverb_core* reverb, float* data, int num_samples)
+{
+	reverb->core.processInterleaved(data, num_samples);
+}
+
+void reverb_core_process_interleaved_double(reverb_core* reverb, double* data, int num_samples)
+{
+	reverb->core.processInterleaved(data, num_samples);
+}
@@ -0,0 +1,65 @@
+
+/*
+  ==============================================================================
+
+C++ interface to the reverb core (no JUCE).
+
+The engine templates stay inside the library, so including this only pulls in
+the standard library. See reverb_core.h for the C interface, and ReverbEngine.h
+for the engines themselves.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+class ReverbEngine;
+
+
+class ReverbCore {
+public:
+	enum class StereoMode : int { stereo = 0, binaural, trueStereo };
+
+	// Same order as ParamId (ParameterEvents.h)
+	enum class Parameter : int { size = 0, decay, dry, diffuser, wetReflections, preDelay, modRate, modDepth };
+
+	struct Layout {
+		int numChannels = 2;
+		int lfeChannel = -1;      // host index of the LFE channel, or -1
+		int ambisonicOrder = -1;  // 1-3 for AmbiX buses, or -1
+		StereoMode stereoMode = StereoMode::stereo;
+	};
+
+	// Allocates. Call configure() before processing.
+	explicit ReverbCore(const Layout &layout);
+	~ReverbCore();
+
+	ReverbCore(const ReverbCore &) = delete;
+	ReverbCore & operator=(const ReverbCore &) = delete;
+
+	// Allocates
+	void configure(double sampleRate);
+
+	// The random delay times, reflection taps and modulation all come from this. The same seed,
+	// parameters and input give the same output. Takes effect at the next configure().
+	void setSeed(uint32_t seed);
+	uint32_t getSeed() const;
+
+	// No allocation, so these are fine on the audio thread
+	void setParameter(Parameter parameter, double value);
+	void retriggerModulation();
+
+	int getNumChannels() const;
+
+	// In place, planar (one pointer per channel) or interleaved
+	void process(float* const* channels, int numSamples);
+	void process(double* const* channels, int numSamples);
+	void processInterleaved(float* data, int numSamples);
+	void processInterleaved(double* data, int numSamples);
+
+private:
+	std::unique_ptr<ReverbEngine> engine;
+};
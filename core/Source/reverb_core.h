@@ -0,0 +1,71 @@
+
+/*
+  ==============================================================================
+
+C interface to the reverb core (no JUCE).
+
+    reverb_core* reverb = reverb_core_create(2, -1, -1, REVERB_STEREO_MODE_STEREO);
+    reverb_core_configure(reverb, 48000.0);
+    reverb_core_set_parameter(reverb, REVERB_PARAM_DECAY, 3.0);
+    reverb_core_process_float(reverb, channels, numSamples);  // in place
+    reverb_core_destroy(reverb);
+
+create and configure allocate. set_parameter and the process calls don't, so
+they are safe on a realtime thread. One instance must not be used from two
+threads at once.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct reverb_core reverb_core;
+
+/* Same order as ParamId (ParameterEvents.h) */
+typedef enum reverb_param {
+	REVERB_PARAM_SIZE = 0,         /* room size, ms (10 - 200) */
+	REVERB_PARAM_DECAY,            /* RT60, seconds */
+	REVERB_PARAM_DRY,              /* dry gain */
+	REVERB_PARAM_DIFFUSER,         /* late (diffuser + feedback) gain */
+	REVERB_PARAM_WET_REFLECTIONS,  /* early reflection gain */
+	REVERB_PARAM_PREDELAY,         /* ms */
+	REVERB_PARAM_MOD_RATE,         /* Hz */
+	REVERB_PARAM_MOD_DEPTH         /* ms (0 - 5) */
+} reverb_param;
+
+typedef enum reverb_stereo_mode {
+	REVERB_STEREO_MODE_STEREO = 0,
+	REVERB_STEREO_MODE_BINAURAL,
+	REVERB_STEREO_MODE_TRUE_STEREO
+} reverb_stereo_mode;
+
+/* lfe_channel and ambisonic_order are -1 when not used. Returns NULL on failure. */
+reverb_core* reverb_core_create(int num_channels, int lfe_channel, int ambisonic_order, reverb_stereo_mode stereo_mode);
+void reverb_core_destroy(reverb_core* reverb);
+
+/* Returns 0 on success */
+int reverb_core_configure(reverb_core* reverb, double sample_rate);
+
+/* For repeatable output (same seed, parameters and input, same output). Takes effect at the next configure. */
+void reverb_core_set_seed(reverb_core* reverb, uint32_t seed);
+
+void reverb_core_set_parameter(reverb_core* reverb, reverb_param param, double value);
+void reverb_core_retrigger_modulation(reverb_core* reverb);
+
+int reverb_core_num_channels(const reverb_core* reverb);
+
+/* In place. Planar: one pointer per channel. Interleaved: num_samples frames of num_channels samples. */
+void reverb_core_process_float(reverb_core* reverb, float* const* channels, int num_samples);
+void reverb_core_process_double(reverb_core* reverb, double* const* channels, int num_samples);
+void reverb_core_process_interleaved_float(reverb_core* reverb, float* data, int num_samples);
+void reverb_core_process_interleaved_double(reverb_core* reverb, double* data, int num_samples);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,75 @@
+
+/*
+  ==============================================================================
+
+Directions and spherical harmonics for placing FDN channels around the listener.
+
+Ambisonics use the AmbiX convention: ACN channel order, SN3D normalisation.
+Angles are in radians. Azimuth is anticlockwise from the front, elevation up
+from the horizontal plane.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "common.h"  // M_PI
+
+#include <array>
+#include <cmath>
+
+
+struct Direction {
+	double azimuth = 0;
+	double elevation = 0;
+};
+
+
+// N roughly evenly spread directions over the whole sphere (Fibonacci spiral)
+template<int count>
+std::array<Direction, count> fibonacciSphere() {
+	std::array<Direction, count> directions;
+	const double goldenAngle = M_PI*(3 - std::sqrt(5.0));
+	for (int i = 0; i < count; ++i) {
+		double z = 1 - (i + 0.5)*2/count;
+		directions[i].elevation = std::asin(z);
+		directions[i].azimuth = std::remainder(goldenAngle*i, 2*M_PI);
+	}
+	return directions;
+}
+
+
+constexpr int ambisonicChannels(int order) {
+	return (order + 1)*(order + 1);
+}
+
+// Real spherical harmonics up to 3rd order (ACN/SN3D). Writes ambisonicChannels(order) values.
+template<class Output>
+void sphericalHarmonicsSN3D(const Direction &direction, int order, Output &&output) {
+	const double cosElevation = std::cos(direction.elevation);
+	const double x = cosElevation*std::cos(direction.azimuth);
+	const double y = cosElevation*std::sin(direction.azimuth);
+	const double z = std::sin(direction.elevation);
+
+	output[0] = 1;
+	if (order < 1) return;
+	output[1] = y;
+	output[2] = z;
+	output[3] = x;
+	if (order < 2) return;
+	const double sqrt3 = std::sqrt(3.0);
+	output[4] = sqrt3*x*y;
+	output[5] = sqrt3*y*z;
+	output[6] = 0.5*(3*z*z - 1);
+	output[7] = sqrt3*x*z;
+	output[8] = 0.5*sqrt3*(x*x - y*y);
+	if (order < 3) return;
+	const double sqrt5_8 = std::sqrt(5.0/8), sqrt15 = std::sqrt(15.0), sqrt3_8 = std::sqrt(3.0/8);
+	output[9] = sqrt5_8*y*(3*x*x - y*y);
+	output[10] = sqrt15*x*y*z;
+	output[11] = sqrt3_8*y*(5*z*z - 1);
+	output[12] = 0.5*z*(5*z*z - 3);
+	output[13] = sqrt3_8*x*(5*z*z - 1);
+	output[14] = 0.5*sqrt15*z*(x*x - y*y);
+	output[15] = sqrt5_8*x*(x*x - 3*y*y);
+}
@@ -0,0 +1,210 @@
+
+/*
+  ==============================================================================
+
+Binaural rendering of the FDN channels.
+
+Every network channel is a virtual speaker at its own direction, rendered to
+two ears through HRIRs with a uniformly-partitioned overlap-save convolver.
+The channels are summed in the frequency domain, so a block costs one forward
+FFT per channel but only one inverse FFT per ear.
+
+No HRIR dataset ships with the plugin, so the default filters come from a
+spherical head model (head shadow plus interaural delay, Brown & Duda 1998).
+Measured HRIRs can be loaded with setImpulseResponse().
+
+The output is delayed by one partition (`latency` samples).
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "Ambisonics.h"
+#include "fft.h"
+
+#include <array>
+#include <complex>
+#include <vector>
+
+
+// Spherical head HRIR for one ear (0 = left, 1 = right). The length sets the FFT size, so keep it "fast".
+inline void sphericalHeadHrir(const Direction &direction, int ear, double sampleRate, std::vector<double> &hrir) {
+	const double headRadius = 0.0875, speedOfSound = 343;
+	const double alphaMin = 0.1, thetaMin = 5*M_PI/6;
+	const double w0 = speedOfSound/headRadius;
+
+	// Angle between the source and the ear axis (left ear at +90 degrees azimuth)
+	double earSide = (ear == 0) ? 1 : -1;
+	double cosTheta = earSide*std::cos(direction.elevation)*std::sin(direction.azimuth);
+	double theta = std::acos(std::max(-1.0, std::min(cosTheta, 1.0)));
+
+	// Head shadow: one pole, one zero. Delay: straight path on the near side, around the head on the far side.
+	double alpha = (1 + alphaMin/2) + (1 - alphaMin/2)*std::cos(theta/thetaMin*M_PI);
+	double delaySeconds = headRadius/speedOfSound*(theta < M_PI/2 ? 1 - cosTheta : 1 + theta - M_PI/2);
+
+	int length = int(hrir.size());
+	int fftSize = 2*length;  // room for the delay and the tail, without wrapping into the kept half
+	signalsmith::fft::RealFFT<double> fft(fftSize);
+	std::vector<std::complex<double>> spectrum(fftSize/2);
+	std::vector<double> impulse(fftSize);
+
+	auto response = [&](double freq) {
+		double w = 2*M_PI*freq;
+		std::complex<double> shadow = std::complex<double>(1, alpha*w/(2*w0))/std::complex<double>(1, w/(2*w0));
+		return shadow*std::polar(1.0, -w*delaySeconds);
+	};
+	// Bin 0 holds DC and Nyquist (both real)
+	spectrum[0] = {response(0).real(), response(sampleRate/2).real()};
+	for (int i = 1; i < fftSize/2; ++i) {
+		spectrum[i] = response(i*sampleRate/fftSize);
+	}
+	fft.ifft(spectrum, impulse);
+
+	// Fade out over the last quarter
+	int fadeStart = length*3/4;
+	for (int i = 0; i < length; ++i) {
+		double gain = 1.0/fftSize;
+		if (i >= fadeStart) gain *= 0.5 + 0.5*std::cos(M_PI*(i - fadeStart)/(length - fadeStart));
+		hrir[i] = impulse[i]*gain;
+	}
+}
+
+
+template<int channels>
+class BinauralRenderer {
+public:
+	static constexpr int partitionSize = 64;
+	static constexpr int latency = partitionSize;
+	static constexpr double hrirSeconds = 0.0025;
+
+private:
+	using Array = std::array<double, channels>;
+	static constexpr int fftSize = 2*partitionSize;
+	static constexpr int bins = fftSize/2;  // RealFFT packs DC and Nyquist into bin 0
+
+	// Split real/imaginary, so the multiply-accumulate vectorises
+	struct Spectrum {
+		std::array<double, bins> real, imag;
+	};
+
+	signalsmith::fft::RealFFT<double> fft{fftSize};
+	int numPartitions = 1;
+	std::vector<Spectrum> filters;       // [partition][ear][channel]
+	std::vector<Spectrum> inputSpectra;  // ring of [partition][channel], newest at inputSlot
+	int inputSlot = 0;
+
+	std::array<std::array<double, fftSize>, channels> inputFrames;  // previous partition, then the current one
+	std::array<std::array<double, partitionSize>, 2> outputs;
+	std::array<Spectrum, 2> sums;
+	std::array<std::complex<double>, bins> complexBuffer;
+	std::array<double, fftSize> timeBuffer;
+	int position = 0;
+
+	Spectrum & filter(int partition, int ear, int channel) {
+		return filters[(partition*2 + ear)*channels + channel];
+	}
+
+	void processPartition() {
+		for (int c = 0; c < channels; ++c) {
+			auto &frame = inputFrames[c];
+			fft.fft(frame, complexBuffer);
+			auto &spectrum = inputSpectra[inputSlot*channels + c];
+			for (int b = 0; b < bins; ++b) {
+				spectrum.real[b] = complexBuffer[b].real();
+				spectrum.imag[b] = complexBuffer[b].imag();
+			}
+			std::copy(frame.begin() + partitionSize, frame.end(), frame.begin());
+		}
+
+		for (int ear = 0; ear < 2; ++ear) {
+			auto &sum = sums[ear];
+			sum.real.fill(0);
+			sum.imag.fill(0);
+			double dc = 0, nyquist = 0;
+
+			for (int p = 0; p < numPartitions; ++p) {
+				int slot = (inputSlot + numPartitions - p)%numPartitions;
+				for (int c = 0; c < channels; ++c) {
+					const auto &x = inputSpectra[slot*channels + c];
+					const auto &h = filter(p, ear, c);
+					for (int b = 0; b < bins; ++b) {
+						sum.real[b] += x.real[b]*h.real[b] - x.imag[b]*h.imag[b];
+						sum.imag[b] += x.real[b]*h.imag[b] + x.imag[b]*h.real[b];
+					}
+					dc += x.real[0]*h.real[0];
+					nyquist += x.imag[0]*h.imag[0];
+				}
+			}
+
+			complexBuffer[0] = {dc, nyquist};
+			for (int b = 1; b < bins; ++b) {
+				complexBuffer[b] = {sum.real[b], sum.imag[b]};
+			}
+			fft.ifft(complexBuffer, timeBuffer);
+			// Overlap-save: the first half has wrapped around
+			std::copy(timeBuffer.begin() + partitionSize, timeBuffer.end(), outputs[ear].begin());
+		}
+
+		inputSlot = (inputSlot + 1)%numPartitions;
+	}
+
+public:
+	// Allocates: sets up the default (spherical head) HRIRs for the Fibonacci-sphere directions
+	void configure(double sampleRate) {
+		int hrirLength = int(std::ceil(hrirSeconds*sampleRate/partitionSize))*partitionSize;
+		numPartitions = hrirLength/partitionSize;
+		filters.assign(numPartitions*2*channels, Spectrum{});
+		inputSpectra.assign(numPartitions*channels, Spectrum{});
+
+		const auto directions = fibonacciSphere<channels>();
+		std::vector<double> hrir(hrirLength);
+		for (int c = 0; c < channels; ++c) {
+			for (int ear = 0; ear < 2; ++ear) {
+				sphericalHeadHrir(directions[c], ear, sampleRate, hrir);
+				setImpulseResponse(c, ear, hrir.data(), hrirLength);
+			}
+		}
+		reset();
+	}
+
+	// Anything past numPartitions*partitionSize is ignored
+	void setImpulseResponse(int channel, int ear, const double *hrir, int length) {
+		for (int p = 0; p < numPartitions; ++p) {
+			timeBuffer.fill(0);
+			for (int i = 0; i < partitionSize && p*partitionSize + i < length; ++i) {
+				timeBuffer[i] = hrir[p*partitionSize + i]*(1.0/fftSize);  // undo the FFT round-trip gain
+			}
+			fft.fft(timeBuffer, complexBuffer);
+			auto &h = filter(p, ear, channel);
+			for (int b = 0; b < bins; ++b) {
+				h.real[b] = complexBuffer[b].real();
+				h.imag[b] = complexBuffer[b].imag();
+			}
+		}
+	}
+
+	void reset() {
+		for (auto &spectrum : inputSpectra) {
+			spectrum.real.fill(0);
+			spectrum.imag.fill(0);
+		}
+		for (auto &frame : inputFrames) frame.fill(0);
+		for (auto &output : outputs) output.fill(0);
+		inputSlot = 0;
+		position = 0;
+	}
+
+	void process(const Array &input, double &left, double &right) {
+		for (int c = 0; c < channels; ++c) {
+			inputFrames[c][partitionSize + position] = input[c];
+		}
+		left = outputs[0][position];
+		right = outputs[1][position];
+
+		if (++position == partitionSize) {
+			position = 0;
+			processPartition();
+		}
+	}
+};
@@ -0,0 +1,110 @@
+
+/*
+  ==============================================================================
+
+CPU load of one plugin instance, as a fraction of the real-time deadline.
+
+The audio thread times each processBlock and divides by the block's duration
+(numSamples/sampleRate), so 1.0 means the block took as long as it lasts.
+It publishes the latest value in an atomic, counts deadline misses (blocks
+that took longer than they last), and sends every block's load through a
+wait-free ring. The message thread drains the ring into CpuLoadHistory for the
+peak and p99 over the last few seconds.
+
+No JUCE in here.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "SpscRing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+
+struct CpuLoadRecord {
+	float load = 0;     // fraction of the deadline
+	float seconds = 0;  // block duration
+};
+
+
+// Audio thread: begin()/end() around the block
+struct CpuMeter {
+	std::atomic<float> currentLoad{0};
+	std::atomic<uint32_t> deadlineMisses{0};  // since the instance was created
+	SpscRing<CpuLoadRecord, 4096> records;
+
+	void begin() {
+		start = std::chrono::steady_clock::now();
+	}
+
+	// Returns the block's load
+	float end(int numSamples, double sampleRate) {
+		if (numSamples <= 0 || sampleRate <= 0) return 0;
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		double deadline = numSamples/sampleRate;
+		CpuLoadRecord record{float(elapsed.count()/deadline), float(deadline)};
+		currentLoad.store(record.load, std::memory_order_relaxed);
+		if (record.load > 1.0f) deadlineMisses.fetch_add(1, std::memory_order_relaxed);
+		records.push(record);  // nobody draining (editor closed) just drops it
+		return record.load;
+	}
+
+private:
+	std::chrono::steady_clock::time_point start;
+};
+
+
+// Message thread: peak and p99 over the most recent `windowSeconds` of audio
+class CpuLoadHistory {
+public:
+	explicit CpuLoadHistory(double windowSeconds = 5.0, int maxBlocks = 1 << 16)
+		: windowSeconds(windowSeconds), history(size_t(maxBlocks)), sorted(size_t(maxBlocks)) {}
+
+	void drain(CpuMeter& meter) {
+		CpuLoadRecord record;
+		while (meter.records.pop(record)) {
+			history[next] = record;
+			next = (next + 1)%history.size();
+			count = std::min(count + 1, history.size());
+		}
+	}
+
+	void clear() {
+		count = 0;
+	}
+
+	struct Summary {
+		float peak = 0, p99 = 0;
+	};
+
+	// Allocation-free, cheap enough to call at the repaint rate
+	Summary summary() {
+		Summary result;
+		size_t blocks = 0;
+		double seconds = 0;
+		while (blocks < count && seconds < windowSeconds) {
+			const auto &record = history[(next + history.size() - 1 - blocks)%history.size()];
+			sorted[blocks++] = record.load;
+			seconds += record.seconds;
+		}
+		if (blocks == 0) return result;
+
+		size_t p99Index = std::min(blocks - 1, blocks*99/100);
+		std::nth_element(sorted.begin(), sorted.begin() + long(p99Index), sorted.begin() + long(blocks));
+		result.p99 = sorted[p99Index];
+		result.peak = *std::max_element(sorted.begin() + long(p99Index), sorted.begin() + long(blocks));
+		return result;
+	}
+
+private:
+	double windowSeconds;
+	std::vector<CpuLoadRecord> history;
+	std::vector<float> sorted;
+	size_t next = 0, count = 0;
+};
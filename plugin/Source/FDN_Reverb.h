@@ -32,9 +32,15 @@ Geraint Luft:  https://signalsmith-audio.co.uk/
 
 #include "delay.h"
 #include "mix.h"
+#include "envelopes.h"
+#include "LazyZeroArray.h"
+#include "StageTiming.h"
+#include "Trace.h"
 
 
 #include <cstdlib>
+#include <cstdint>
+#include <algorithm>
 
 #include <random>
 #include <iostream>
@@ -43,16 +49,34 @@ Geraint Luft:  https://signalsmith-audio.co.uk/
 // This is a simple delay class which rounds to a whole number of samples.
 using Delay = signalsmith::delay::Delay<double, signalsmith::delay::InterpolatorNearest>;
 
+// All channels of a stage in one interleaved buffer. Reads are linearly interpolated,
+// for delay times that move while running (room size, modulation).
+// The memory comes from lazily-zeroed OS pages, so it isn't touched until audio reaches it.
+template<int channels>
+using MultiDelayLine = signalsmith::delay::InterleavedMultiDelay<double, channels,
+	signalsmith::delay::MultiInterpolatorLinear<double, channels>, LazyZeroArray>;
+
 
+// Charges the time since the last lap to a stage (StageTiming.h), once per stage per block.
+// Empty unless built with REVERB_STAGE_TIMING.
+#if REVERB_STAGE_TIMING
+	#define REVERB_STAGE_LAP(timer, stage) do { if (timer) (timer)->lap(Stage::stage); } while (false)
+#else
+	#define REVERB_STAGE_LAP(timer, stage) do {} while (false)
+#endif
 
 
 struct randomInRange {
-	// Member-based RNG, seeded once and used for all random calls
+	// One RNG per thread. Engines seed it before configuring, so the same seed gives the same reverb.
 	static std::mt19937& getRng() {
-		static std::mt19937 rng(std::random_device{}());
+		thread_local std::mt19937 rng(std::random_device{}());
 		return rng;
 	}
 
+	static void seed(uint32_t seed) {
+		getRng().seed(seed);
+	}
+
 	static bool bernoulliDistribution() {
 		static std::bernoulli_distribution bDist(0.5);
 		return bDist(getRng());
@@ -71,53 +95,81 @@ struct randomInRange {
 
 
 
-template<int channels=8>
+// The network stages take a `networks` count: that many independent networks run side by side,
+// interleaved as [channel][network]. They share the delay times and modulation, and every mixing
+// step handles all the networks at once (true stereo, see ReverbEngine.h).
+
+template<int channels=8, int networks=1>
 struct MultiChannelMixedFeedback {
-	using Array = std::array<double, channels>;
+	static constexpr int width = channels*networks;
+	using Array = std::array<double, width>;
+	using ChannelArray = std::array<double, channels>;
 	double delayMs = 150;
+	double maxDelayMs = 200;  // lines are allocated for this, so delayMs can move freely
+	double maxModulationMs = 0;
 	double decayGain = 0.85;
 
-	std::array<int, channels> delaySamples;
-	std::array<Delay, channels> delays;
+	ChannelArray delayRatios;
+	ChannelArray delaySamples;
+	ChannelArray modulation{};  // extra delay in samples, per channel
+	MultiDelayLine<width> delays;
+	double samplesPerMs = 44.1;
 	
 	void configure(double sampleRate) {
-		double delaySamplesBase = delayMs*0.001*sampleRate;
+		REVERB_TRACE_SCOPE("MultiChannelMixedFeedback::configure");
+		samplesPerMs = 0.001*sampleRate;
 		for (int c = 0; c < channels; ++c) {
 			double r = c*1.0/channels;
-			delaySamples[c] = std::pow(2, r)*delaySamplesBase;
-			delays[c].resize(delaySamples[c] + 1);
-			delays[c].reset();
+			delayRatios[c] = std::pow(2, r);
+		}
+		// Longest channel is the last one
+		delays.resize(static_cast<int>(std::ceil((delayRatios[channels - 1]*maxDelayMs + maxModulationMs)*samplesPerMs)) + 1);
+		setDelayMs(delayMs);
+	}
+
+	// No allocation or reset, so this can be called every sample
+	void setDelayMs(double ms) {
+		delayMs = std::min(ms, maxDelayMs);
+		double delaySamplesBase = delayMs*samplesPerMs;
+		for (int c = 0; c < channels; ++c) {
+			delaySamples[c] = delayRatios[c]*delaySamplesBase;
 		}
 	}
 	
 	Array process(Array input) {
+		ChannelArray readDelays;
 		Array delayed;
 		for (int c = 0; c < channels; ++c) {
-			delayed[c] = delays[c].read(delaySamples[c]);
+			readDelays[c] = delaySamples[c] + modulation[c];
 		}
+		delays.template readGroups<networks>(readDelays, delayed);
 		
 		
 		
 		// Mix using a Householder matrix
-		signalsmith::mix::Householder<double, channels>::inPlace(delayed.data());  
+		signalsmith::mix::Householder<double, channels>::template interleavedInPlace<networks>(delayed.data());  
 		
 		
-		for (int c = 0; c < channels; ++c) {
-			double sum = input[c] + delayed[c]*decayGain;
-			delays[c].write(sum);
+		Array sum;
+		for (int c = 0; c < width; ++c) {
+			sum[c] = input[c] + delayed[c]*decayGain;
 		}
+		delays.write(sum);
 		
 		return delayed;
 	}
 };
 
-template<int channels=8>
+template<int channels=8, int networks=1>
 struct DiffusionStep {
-	using Array = std::array<double, channels>;
+	static constexpr int width = channels*networks;
+	using Array = std::array<double, width>;
 	double delayMsRange = 50;
+	double maxModulationMs = 0;
 	
 	std::array<int, channels> delaySamples;  // read positions
-	std::array<Delay, channels> delays;
+	std::array<double, channels> modulation{};  // extra delay in samples, per channel
+	MultiDelayLine<width> delays;
 	std::array<bool, channels> flipPolarity;
 
 	
@@ -125,35 +177,41 @@ struct DiffusionStep {
 
 	// create random delay times (sample time)
 	void configure(double sampleRate) {     
+		REVERB_TRACE_SCOPE("DiffusionStep::configure");
 		double delaySamplesRange = delayMsRange*0.001*sampleRate;
 		
 		for (int c = 0; c < channels; ++c) {
 			double rangeLow = delaySamplesRange*c/channels;
 			double rangeHigh = delaySamplesRange*(c + 1)/channels;
 			delaySamples[c] = randomInRange::generateRandomReal<double>(rangeLow, rangeHigh); 
-			delays[c].resize(delaySamples[c] + 1);
-			delays[c].reset();
 			flipPolarity[c] = randomInRange::bernoulliDistribution();  //rand() % 2;  
 		}
+
+		int maxDelaySamples = *std::max_element(delaySamples.begin(), delaySamples.end());
+		int modulationSamples = static_cast<int>(std::ceil(maxModulationMs*0.001*sampleRate));
+		delays.resize(maxDelaySamples + modulationSamples + 1);
 	}
 	
 	Array process(Array input) {    // after 2-4 K samples it becomes continues sounding reverbish, and not discret.
 		// Delay
+		std::array<double, channels> readDelays;
 		Array delayed;
 		for (int c = 0; c < channels; ++c) {
-			delays[c].write(input[c]);
-			delayed[c] = delays[c].read(delaySamples[c]);
+			readDelays[c] = delaySamples[c] + modulation[c];
 		}
+		delays.write(input).template readGroups<networks>(readDelays, delayed);
 		
 	
 
 		// Flip some polarities,  does not shuffle
 		for (int c = 0; c < channels; ++c) {
-			if (flipPolarity[c]) delayed[c] *= -1;
+			if (flipPolarity[c]) {
+				for (int n = 0; n < networks; ++n) delayed[c*networks + n] *= -1;
+			}
 		}
 
 		// Mix with a Hadamard matrix
-		signalsmith::mix::Hadamard<double, channels>::inPlace(delayed.data());
+		signalsmith::mix::Hadamard<double, channels>::template interleavedInPlace<networks>(delayed.data());
 
 		return delayed;
 	} 
@@ -161,13 +219,15 @@ struct DiffusionStep {
 
 
 
-template<int channels=8, int stepCount=4>
+template<int channels=8, int stepCount=4, int networks=1>
 struct DiffuserHalfLengths {
-	using Array = std::array<double, channels>;
+	using Array = std::array<double, channels*networks>;
 
-	std::array<DiffusionStep<channels>, stepCount> steps;
+	std::array<DiffusionStep<channels, networks>, stepCount> steps;
 
-	
+	void setMaxModulationMs(double ms) {
+		for (auto &step : steps) step.maxModulationMs = ms;
+	}
 	    
 	void setDelayMsRange(double diffusionMs) 
 	{
@@ -193,44 +253,134 @@ struct DiffuserHalfLengths {
 
 
 
-template<int channels = 8>
-struct EarlyReflections {
-	using Array = std::array<double, channels>;
+// Slow random delay-time modulation, one lane per delay line.
+// The LFO bank only runs every controlInterval samples, and is linearly interpolated in between.
+template<int lanes>
+struct DelayModulation {
+	using Array = std::array<double, lanes>;
+	static constexpr int controlInterval = 32;
 
-	std::array<Delay, channels> delays;
-	std::array<double, channels> gains;
-	std::array<int, channels> delaySamples;
+	signalsmith::envelopes::CubicLfoBank<lanes> lfo;
+	std::array<float, lanes> target{};
+	Array targetSamples{};
+	Array current{};    // modulation in samples
+	Array increment{};
 
-	double minDelayMs = 5;
-	double maxDelayMs = 30;
+	double rateHz = 0.5;
+	double depthMs = 0;
+	double depthSamples = 0;
+	double sampleRate = 44100;
+	int counter = 0;
+	bool active = false;
 
-	// Configure delay range based on room size
-	void configureDelayRange(double minMs, double maxMs, double sampleRate) {
-		minDelayMs = minMs;
-		maxDelayMs = maxMs;
+	void configure(double newSampleRate) {
+		sampleRate = newSampleRate;
+		lfo.setSeed(long(randomInRange::getRng()()));  // from the engine's seed, like the delay times
+		setDepthMs(depthMs);
+		setRateHz(rateHz);
+		targetSamples.fill(0);
+		current.fill(0);
+		retrigger();
+	}
+
+	void setRateHz(double hz) {
+		rateHz = hz;
+		// Rate is per call to lfo.next(), which happens once per control interval
+		lfo.set(0, 1, static_cast<float>(rateHz*controlInterval/sampleRate), 0.3f);
+	}
 
-		configure(sampleRate);
+	void setDepthMs(double ms) {
+		depthMs = ms;
+		depthSamples = depthMs*0.001*sampleRate;
+		if (depthSamples > 0) active = true;
+	}
+
+	// Restart the LFOs from the same point, for repeatable modulation.
+	// Glides from wherever the lines currently are, so there's no jump.
+	void retrigger() {
+		lfo.retrigger();
+		targetSamples = current;
+		increment.fill(0);
+		counter = 0;
+	}
+
+	bool isActive() const {
+		return active;
+	}
+
+	// Advances one sample, returns the modulation for every lane in samples
+	const Array & next() {
+		if (counter == 0) {
+			// Land exactly on the previous target, so a ramp down to 0 really ends at 0
+			current = targetSamples;
+			if (depthSamples == 0 && std::all_of(current.begin(), current.end(), [](double v) { return v == 0; })) {
+				active = false;
+			}
+			lfo.next(target);
+			for (int l = 0; l < lanes; ++l) {
+				targetSamples[l] = target[l]*depthSamples;
+				increment[l] = (targetSamples[l] - current[l])*(1.0/controlInterval);
+			}
+			counter = controlInterval;
+		}
+		--counter;
+		for (int l = 0; l < lanes; ++l) current[l] += increment[l];
+		return current;
 	}
+};
+
+
+template<int channels = 8, int networks = 1>
+struct EarlyReflections {
+	static constexpr int width = channels*networks;
+	using Array = std::array<double, width>;
+
+	MultiDelayLine<width> delays;
+	std::array<double, channels> gains;
+	std::array<double, channels> tapPositions;  // 0-1 within the reflection range, fixed at configure
+	std::array<double, channels> delaySamples;
+	double rmsGain = 0.4;  // of the taps, for passing the input through at the same level when bypassed
+
+	// Reflection times scale with the room size
+	double minDelayRatio = 0.1;
+	double maxDelayRatio = 0.3;
+	double roomSizeMs = 50;
+	double maxRoomSizeMs = 200;
+	double samplesPerMs = 44.1;
 
 	void configure(double sampleRate) {
+		REVERB_TRACE_SCOPE("EarlyReflections::configure");
+		samplesPerMs = 0.001*sampleRate;
+		int maxDelaySamples = static_cast<int>(std::ceil(maxRoomSizeMs*maxDelayRatio*samplesPerMs));
 		for (int c = 0; c < channels; ++c) {
-			double reflectionTimeMs = randomInRange::generateRandomReal<double>(minDelayMs, maxDelayMs);
-			delaySamples[c] = reflectionTimeMs * 0.001 * sampleRate;
-			delays[c].resize(delaySamples[c] + 1);
-			delays[c].reset();
-
+			tapPositions[c] = randomInRange::generateRandomReal<double>(0.0, 1.0);
 			gains[c] = randomInRange::generateRandomReal<double>(0.2, 0.6);
 		}
+		double sumSquares = 0;
+		for (double gain : gains) sumSquares += gain*gain;
+		rmsGain = std::sqrt(sumSquares/channels);
+		delays.resize(maxDelaySamples + 1);
+		setRoomSize(roomSizeMs);
+	}
+
+	// No allocation or reset, so this can be called every sample
+	void setRoomSize(double ms) {
+		roomSizeMs = std::min(ms, maxRoomSizeMs);
+		double low = roomSizeMs*minDelayRatio*samplesPerMs;
+		double high = roomSizeMs*maxDelayRatio*samplesPerMs;
+		for (int c = 0; c < channels; ++c) {
+			delaySamples[c] = low + tapPositions[c]*(high - low);
+		}
 	}
 
 	Array process(const Array& input) {
 		Array earlyReflections;
+		delays.write(input).template readGroups<networks>(delaySamples, earlyReflections);
 		for (int c = 0; c < channels; ++c) {
-			delays[c].write(input[c]);
-			earlyReflections[c] = delays[c].read(delaySamples[c]) * gains[c];
+			for (int n = 0; n < networks; ++n) earlyReflections[c*networks + n] *= gains[c];
 		}
 
-		signalsmith::mix::Hadamard<double, channels>::inPlace(earlyReflections.data());
+		signalsmith::mix::Hadamard<double, channels>::template interleavedInPlace<networks>(earlyReflections.data());
 
 		return earlyReflections;
 	}
@@ -241,66 +391,101 @@ template<int channels>
 struct PreDelay {
 	using Array = std::array<double, channels>;
 
-	std::array<Delay, channels> delays;
-	std::array<int, channels> delaySamples;
+	// Same delay on every channel, so each read is one whole frame
+	signalsmith::delay::InterleavedMultiBuffer<double, channels, LazyZeroArray> buffer;
+	int delaySamples = 0;
 	double preDelayMs = 20;  // Default value for pre-delay
+	double maxPreDelayMs = 500;  // the buffer is allocated for this, so preDelayMs can move freely
+	double samplesPerMs = 44.1;
 
-	// Configure each delay line based on sample rate
+	// Configure the delay line based on sample rate
 	void configure(double sampleRate) {
-		int delayInSamples = static_cast<int>(preDelayMs * 0.001 * sampleRate);
-		for (int c = 0; c < channels; ++c) {
-			delaySamples[c] = delayInSamples;
-			delays[c].resize(delaySamples[c] + 1);
-			delays[c].reset();
-		}
+		REVERB_TRACE_SCOPE("PreDelay::configure");
+		samplesPerMs = 0.001*sampleRate;
+		buffer.resize(static_cast<int>(std::ceil(maxPreDelayMs*samplesPerMs)) + 1);
+		setPreDelayMs(preDelayMs);
 	}
 
-	// Set the pre-delay time for all channels
-	void setPreDelayMs(double ms, double sampleRate) {
-		preDelayMs = ms;
-		configure(sampleRate);
+	// Set the pre-delay time for all channels. No allocation or reset, so fine on the audio thread.
+	void setPreDelayMs(double ms) {
+		preDelayMs = std::min(ms, maxPreDelayMs);
+		delaySamples = static_cast<int>(preDelayMs*samplesPerMs);
 	}
 
 	// Process each channel in the array
 	Array process(const Array& input) {
 		Array delayedOutput;
-		for (int c = 0; c < channels; ++c) {
-			delays[c].write(input[c]);
-			delayedOutput[c] = delays[c].read(delaySamples[c]);
-		}
+		buffer.write(input);
+		buffer.read(delaySamples, delayedOutput);
 		return delayedOutput;
 	}
 };
 
 
-template<int channels=8, int diffusionSteps=4>
+template<int channels, int diffusionSteps, int networks>
+class NetworkPipeline;
+
+template<int channels=8, int diffusionSteps=4, int networks=1>
 struct BasicReverb {
-	using Array = std::array<double, channels>;
+	static constexpr int width = channels*networks;
+	using Array = std::array<double, width>;
 	
-	MultiChannelMixedFeedback<channels> feedback;
-	DiffuserHalfLengths<channels, diffusionSteps> diffuser; 
-	EarlyReflections<channels> earlyReflections;
-	PreDelay<channels> preDelay;  // Multichannel pre-delay
+	MultiChannelMixedFeedback<channels, networks> feedback;
+	DiffuserHalfLengths<channels, diffusionSteps, networks> diffuser; 
+	EarlyReflections<channels, networks> earlyReflections;
+	PreDelay<width> preDelay;  // Multichannel pre-delay
+	DelayModulation<channels*(diffusionSteps + 1)> modulation;  // FDN lines, then each diffusion step
 
 	double dry = 0.5;
 	double diffuserGain = 0.3;
 	double earlyReflectionGain = 0.0;
+	bool earlyReflectionsEnabled = true;  // off: the input goes straight to the pre-delay (cheap tier)
 	
 
-	double roomSizeMs = 50.0;
+	static constexpr double maxRoomSizeMs = 200.0;  // top of the SIZE parameter range
+	static constexpr double maxModulationMs = 5.0;  // top of the MOD_DEPTH parameter range
+	static constexpr double maxPreDelayMs = 500.0;  // top of the PREDELAY parameter range
+
+	double roomSizeMs = 50.0;          // target
+	double smoothedRoomSizeMs = 50.0;  // what the delay lines are currently using
+	double targetDecayGain = 0.85;
+	double smoothing = 0.001;          // one-pole coefficient, set in configure()
 	double rt60 = 6.0;
 	double sampleRate = 44100.0;
 
 	
 	const double scalingFactor = 1.0 / std::sqrt(channels);
+	// The stereo up/downmix passes the dry signal at (channels/2)*scalingFactor. Scaled to match the
+	// 8-channel network, so every network size has the same dry level.
+	const double mixedDryGain = std::sqrt(8.0 / channels);
+
+	signalsmith::mix::StereoMultiMixer<double, channels> mix;
+
+	// processWetBlock() runs each stage over up to this many frames before moving on to the next
+	static constexpr int stageBlockSize = 64;
+	// For the engines' channel mapping: fill inputFrames, and processWetBlock() into wetFrames
+	std::array<Array, stageBlockSize> inputFrames, wetFrames;
+
+#if REVERB_STAGE_TIMING
+	StageTimer *timer = nullptr;  // set by the engine
+#endif
 
-	signalsmith::mix::StereoMultiMixer<float, channels> mix;
+	// Set by the engine when pipelined: the early half runs here, the late half on the worker,
+	// and the wet output comes out pipeline->getLatency() samples late
+	NetworkPipeline<channels, diffusionSteps, networks> *pipeline = nullptr;
 
 	BasicReverb() 
 	{
+		feedback.maxDelayMs = maxRoomSizeMs;
+		feedback.maxModulationMs = maxModulationMs;
+		diffuser.setMaxModulationMs(maxModulationMs);
+		earlyReflections.maxRoomSizeMs = maxRoomSizeMs;
+		preDelay.maxPreDelayMs = maxPreDelayMs;
+
 		// try differenct values
 		diffuser.setDelayMsRange(50);
 		updateDecayGain();
+		feedback.decayGain = targetDecayGain;
 	}
 	
 	void setDry(double dryValue)
@@ -320,27 +505,33 @@ struct BasicReverb {
 
 	void setPreDelay(double timeMs)
 	{
-		preDelay.setPreDelayMs(timeMs, sampleRate);
+		preDelay.setPreDelayMs(timeMs);
 	}
 
+	// Only sets the target. The FDN and early reflection delay times glide towards it in process(),
+	// reading the preallocated lines with interpolation, so this never allocates or resets.
 	void setRoomSize(double sizeValue)
 	{
-		roomSizeMs = sizeValue;
+		roomSizeMs = std::min(sizeValue, maxRoomSizeMs);
 		//diffuser.setDelayMsRange(roomSizeMs);
 		//diffuser.configure(sampleRate);
 
 		updateDecayGain();
+	}
 
-		// Set early reflection delay ranges based on room size
-		if (roomSizeMs <= 50) {  // Small room
-			earlyReflections.configureDelayRange(5, 15, sampleRate); // Small reflection times
-		}
-		else if (roomSizeMs <= 100) {  // Medium room
-			earlyReflections.configureDelayRange(10, 30, sampleRate);
-		}
-		else {  // Large room
-			earlyReflections.configureDelayRange(20, 50, sampleRate);
-		}
+	void setModulationDepth(double depthMs)
+	{
+		modulation.setDepthMs(std::min(depthMs, maxModulationMs));
+	}
+
+	void setModulationRate(double rateHz)
+	{
+		if (rateHz != modulation.rateHz) modulation.setRateHz(rateHz);
+	}
+
+	void retriggerModulation()
+	{
+		modulation.retrigger();
 	}
 
 	void setDecay(double decayValue)
@@ -351,8 +542,6 @@ struct BasicReverb {
 
 	void updateDecayGain()
 	{
-		feedback.delayMs = roomSizeMs;
-
 		// How long does our signal take to go around the feedback loop?
 		double typicalLoopMs = roomSizeMs * 1.5;
 		// How many times will it do that during our RT60 period?
@@ -360,71 +549,193 @@ struct BasicReverb {
 		// This tells us how many dB to reduce per loop
 		double dbPerCycle = -60 / loopsPerRt60;
 
-		feedback.decayGain = std::pow(10, dbPerCycle * 0.05);   
+		targetDecayGain = std::pow(10, dbPerCycle * 0.05);   
+
+	}
+
+	// Moves the room size and decay gain one sample towards their targets. False if they were already there.
+	bool glideParameters()
+	{
+		if (smoothedRoomSizeMs == roomSizeMs && feedback.decayGain == targetDecayGain) return false;
+
+		smoothedRoomSizeMs += (roomSizeMs - smoothedRoomSizeMs) * smoothing;
+		feedback.decayGain += (targetDecayGain - feedback.decayGain) * smoothing;
+		if (std::abs(roomSizeMs - smoothedRoomSizeMs) < 1e-6) smoothedRoomSizeMs = roomSizeMs;
+		if (std::abs(targetDecayGain - feedback.decayGain) < 1e-9) feedback.decayGain = targetDecayGain;
+		return true;
+	}
+
+	void updateSmoothedParameters()
+	{
+		if (!glideParameters()) return;
 
+		feedback.setDelayMs(smoothedRoomSizeMs);
+		earlyReflections.setRoomSize(smoothedRoomSizeMs);
 	}
 
 
 	void configure(double newSampleRate) 
 	{
+		sampleRate = newSampleRate;
+		smoothing = 1.0 - std::exp(-1.0 / (0.05 * sampleRate));  // ~50ms glide
+
+		// Start at the target, no glide after a reconfigure
+		smoothedRoomSizeMs = roomSizeMs;
+		feedback.decayGain = targetDecayGain;
+		feedback.delayMs = roomSizeMs;
+		earlyReflections.roomSizeMs = roomSizeMs;
+
 		feedback.configure(sampleRate);
 		diffuser.configure(sampleRate);
 		earlyReflections.configure(sampleRate);
 		preDelay.configure(sampleRate);
-		sampleRate = newSampleRate;
+		modulation.configure(sampleRate);
+	}
+
+	// The first lanes go to feedbackLanes (the FDN's own, or held back for its pass), the rest to the diffusion steps
+	void applyModulation(const typename DelayModulation<channels*(diffusionSteps + 1)>::Array &offsets,
+	                     std::array<double, channels> &feedbackLanes)
+	{
+		auto *lane = offsets.data();
+		std::copy(lane, lane + channels, feedbackLanes.begin());
+		for (auto &step : diffuser.steps) {
+			lane += channels;
+			std::copy(lane, lane + channels, step.modulation.begin());
+		}
 	}
 	
 	
 
 
-	// It process by sample. Feed it a buffer writer pointer. Is called from AudioPluginAudioProcessor  processBlock()
-	void process(float* ch1, float* ch2, int numSamples) 
+	// Up to stageBlockSize frames through the network: early reflections, pre-delay, diffuser, feedback.
+	// Each stage runs over the whole block before the next, with the parameter glide and the
+	// modulation replayed per frame, so the output is the same as one sample at a time.
+	// Writes the wet multichannel signal (late + early), before the output scaling.
+	// With more than one network, frames are interleaved as [channel][network].
+	void processWetBlock(const Array* input, Array* wet, int numFrames)
 	{
-		
-		// In: store incoming 2 channel input ch1/ch2.
-		// Out: is the multichannel output from this reverb process.
-		// Out is mixed down to 2 ch In, and then used to overwrite ch1/ch2 
-		std::array<double, channels> out = {};
-		std::array<float, 2> in = {};
-		
-		
-		for (int i = 0; i < numSamples; i++)
+		for (int i = 0; i < numFrames; ++i)
 		{
-			in[0] = ch1[i];
-			in[1] = ch2[i];
+			gliding[i] = glideParameters();
+			glidedRoomSizeMs[i] = smoothedRoomSizeMs;
+			glidedDecayGain[i] = feedback.decayGain;
+		}
+		REVERB_STAGE_LAP(timer, output);
 
-			mix.stereoToMulti(in, out);
+		for (int i = 0; i < numFrames; ++i)
+		{
+			if (gliding[i]) earlyReflections.setRoomSize(glidedRoomSizeMs[i]);
+			if (earlyReflectionsEnabled)
+				earlyFrames[i] = earlyReflections.process(input[i]);
+			else
+				for (int c = 0; c < width; ++c) earlyFrames[i][c] = input[i][c] * earlyReflections.rmsGain;
+		}
+		REVERB_STAGE_LAP(timer, earlyReflections);
 
-			// Early reflections
-			Array earlyReflection = earlyReflections.process(out);
+		// Apply pre-delay to the early reflection output
+		for (int i = 0; i < numFrames; ++i) earlyFrames[i] = preDelay.process(earlyFrames[i]);
+		REVERB_STAGE_LAP(timer, preDelay);
 
-			// Apply pre-delay to the early reflection output
-			earlyReflection = preDelay.process(earlyReflection);
+		if (pipeline != nullptr)
+		{
+			// The late half is on the worker (it glides and modulates its own network)
+			Array delayedEarly, longLasting;
+			for (int i = 0; i < numFrames; ++i)
+			{
+				pipeline->exchange(earlyFrames[i], delayedEarly, longLasting);
+				mixWet(longLasting, delayedEarly, wet[i]);
+			}
+			return;
+		}
 
-			Array diffuse = diffuser.process(earlyReflection);     
-			Array longLasting = feedback.process(diffuse);
-			
+		for (int i = 0; i < numFrames; ++i)
+		{
+			modulated[i] = modulation.isActive();
+			if (modulated[i]) applyModulation(modulation.next(), feedbackModulation[i]);
+			wet[i] = diffuser.process(earlyFrames[i]);
+		}
+		REVERB_STAGE_LAP(timer, diffuser);
 
-			
-		
-			
+		for (int i = 0; i < numFrames; ++i)
+		{
+			feedback.decayGain = glidedDecayGain[i];
+			if (gliding[i]) feedback.setDelayMs(glidedRoomSizeMs[i]);
+			if (modulated[i]) feedback.modulation = feedbackModulation[i];
+			wet[i] = feedback.process(wet[i]);
+		}
+		REVERB_STAGE_LAP(timer, feedback);
 
-			for (int c = 0; c < channels; ++c) 
-			{													
-				//out[c] = dry * out[c] * scalingFactor + diffuserGain * longLasting[c] * scalingFactor + earlyReflection[c] * earlyReflectionGain * scalingFactor; 
-				out[c] = (dry * out[c] + diffuserGain * longLasting[c] + earlyReflection[c] * earlyReflectionGain) * scalingFactor;
-			}
+		for (int i = 0; i < numFrames; ++i) mixWet(wet[i], earlyFrames[i], wet[i]);
+	}
 
-			
+	// The late half of the network on its own: the pipeline's worker runs this (NetworkPipeline.h)
+	Array processLate(const Array& earlyReflection)
+	{
+		updateSmoothedParameters();
+		if (modulation.isActive()) applyModulation(modulation.next(), feedback.modulation);
+		return feedback.process(diffuser.process(earlyReflection));
+	}
 
-			mix.multiToStereo(out, in);
+	double reflectionGain() const
+	{
+		return earlyReflectionsEnabled ? earlyReflectionGain : 0.0;
+	}
 
-			ch1[i] = in[0];
-			ch2[i] = in[1];
+	void mixWet(const Array& longLasting, const Array& earlyReflection, Array& wet) const
+	{
+		for (int c = 0; c < width; ++c)
+		{
+			wet[c] = diffuserGain * longLasting[c] + earlyReflection[c] * reflectionGain();
 		}
 	}
 
+
+	// Feed it a buffer writer pointer. Is called from the stereo engine (ReverbEngine.h)
+	// Channel is a float or double pointer (a double buffer is read and written without conversion),
+	// or anything else indexed by sample, such as a strided view of an interleaved buffer.
+	template<class Channel>
+	void process(Channel ch1, Channel ch2, int numSamples) 
+	{
+		using Sample = std::remove_reference_t<decltype(ch1[0])>;
+		static_assert(networks == 1, "the stereo mixer is for a single network");
 		
+		// In: store incoming 2 channel input ch1/ch2.
+		// inputFrames: the multichannel input, wetFrames: the multichannel output from this reverb process.
+		// Both are mixed down to 2 ch In, and then used to overwrite ch1/ch2 
+		std::array<double, channels> out = {};
+		std::array<double, 2> in = {};
+		
+		for (int start = 0; start < numSamples; start += stageBlockSize)
+		{
+			const int length = std::min(stageBlockSize, numSamples - start);
+			for (int i = 0; i < length; i++)
+			{
+				in[0] = ch1[start + i];
+				in[1] = ch2[start + i];
+				mix.stereoToMulti(in, inputFrames[i]);
+			}
+
+			processWetBlock(inputFrames.data(), wetFrames.data(), length);
+
+			for (int i = 0; i < length; i++)
+			{
+				for (int c = 0; c < channels; ++c) 
+				{
+					out[c] = (dry * mixedDryGain * inputFrames[i][c] + wetFrames[i][c]) * scalingFactor;
+				}
+
+				mix.multiToStereo(out, in);
 
+				ch1[start + i] = static_cast<Sample>(in[0]);
+				ch2[start + i] = static_cast<Sample>(in[1]);
+			}
+		}
+	}
 
+private:
+	// processWetBlock(), per frame: the glide for each stage to pick up, and the FDN's modulation
+	std::array<Array, stageBlockSize> earlyFrames;
+	std::array<double, stageBlockSize> glidedRoomSizeMs, glidedDecayGain;
+	std::array<std::array<double, channels>, stageBlockSize> feedbackModulation;
+	std::array<bool, stageBlockSize> gliding, modulated;
 };
\ No newline at end of file
@@ -0,0 +1,189 @@
+
+/*
+  ==============================================================================
+
+Zero-initialised arrays whose memory is only committed when it's written.
+
+Large arrays come straight from the OS (mmap / VirtualAlloc), which hands out
+zero pages lazily. Reserving several MB of delay lines costs next to nothing
+until audio actually reaches them, and nothing is ever written just to clear
+it. Small arrays (under a few pages) use the heap.
+
+This has the parts of the std::vector interface the delay buffers use (resize,
+assign, size, operator[]), so it can be their storage. Unlike std::vector,
+resize() to a new size drops the old contents. T must be trivially copyable.
+
+Writes go through operator[] or data(), which mark the array as touched. Only a
+touched array gets its pages handed back when it's cleared, so resize() followed
+by assign(n, 0) (a delay buffer's resize and reset) maps the region once.
+
+Allocating, resizing and clearing are system calls, so not for the audio thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "RealtimeChecks.h"
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#if defined(_WIN32)
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+#endif
+
+
+template<class T>
+class LazyZeroArray {
+	static_assert(std::is_trivially_copyable<T>::value, "LazyZeroArray is for plain data");
+
+	static constexpr size_t mapThreshold = 64*1024;
+
+	T *items = nullptr;
+	size_t count = 0;
+	bool mapped = false;
+	bool touched = false;  // handed out for writing since it was last all zero
+
+	static T * allocate(size_t n, bool &mapped) {
+		REVERB_RT_CHECK("LazyZeroArray allocate");
+		size_t bytes = n*sizeof(T);
+		mapped = bytes >= mapThreshold;
+		if (mapped) {
+#if defined(_WIN32)
+			void *memory = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+			if (memory == nullptr) throw std::bad_alloc();
+#else
+			void *memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+			if (memory == MAP_FAILED) throw std::bad_alloc();
+#endif
+			return static_cast<T *>(memory);  // already zero
+		}
+		void *memory = ::operator new(bytes, std::align_val_t(alignof(T)));
+		std::memset(memory, 0, bytes);
+		return static_cast<T *>(memory);
+	}
+
+	static void release(T *items, size_t n, bool mapped) {
+		if (items == nullptr) return;
+		REVERB_RT_CHECK("LazyZeroArray release");
+		if (mapped) {
+#if defined(_WIN32)
+			(void)n;
+			VirtualFree(items, 0, MEM_RELEASE);
+#else
+			munmap(items, n*sizeof(T));
+#endif
+		} else {
+			::operator delete(items, std::align_val_t(alignof(T)));
+		}
+	}
+
+	// Mapped pages back to the OS, in place. They read as zero again, and are only committed when written.
+	static void discard(T *items, size_t n) {
+		REVERB_RT_CHECK("LazyZeroArray discard");
+		size_t bytes = n*sizeof(T);
+#if defined(_WIN32)
+		VirtualFree(items, bytes, MEM_DECOMMIT);
+		if (VirtualAlloc(items, bytes, MEM_COMMIT, PAGE_READWRITE) == nullptr) throw std::bad_alloc();
+#elif defined(__linux__)
+		madvise(items, bytes, MADV_DONTNEED);  // private anonymous memory reads as zero afterwards
+#else
+		// MADV_DONTNEED doesn't promise zeros elsewhere, so a fresh mapping over the same range
+		if (mmap(items, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_FIXED, -1, 0) == MAP_FAILED) throw std::bad_alloc();
+#endif
+	}
+
+	static bool isZero(const T &value) {
+		const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&value);
+		for (size_t i = 0; i < sizeof(T); ++i) {
+			if (bytes[i] != 0) return false;
+		}
+		return true;
+	}
+
+public:
+	LazyZeroArray() {}
+	explicit LazyZeroArray(size_t n) {
+		resize(n);
+	}
+	~LazyZeroArray() {
+		release(items, count, mapped);
+	}
+
+	LazyZeroArray(const LazyZeroArray &other) = delete;
+	LazyZeroArray & operator =(const LazyZeroArray &other) = delete;
+	LazyZeroArray(LazyZeroArray &&other) noexcept
+		: items(std::exchange(other.items, nullptr)), count(std::exchange(other.count, 0)), mapped(other.mapped), touched(std::exchange(other.touched, false)) {}
+	LazyZeroArray & operator =(LazyZeroArray &&other) noexcept {
+		std::swap(items, other.items);
+		std::swap(count, other.count);
+		std::swap(mapped, other.mapped);
+		std::swap(touched, other.touched);
+		return *this;
+	}
+
+	// All zero afterwards (the old contents are dropped if the size changes)
+	void resize(size_t n) {
+		if (n == count) return;
+		release(items, count, mapped);
+		items = nullptr;
+		count = 0;
+		if (n > 0) items = allocate(n, mapped);
+		count = n;
+		touched = false;
+	}
+
+	// Clearing to zero hands the pages back to the OS instead of writing them. Untouched, it's already zero.
+	void clear() {
+		if (count == 0 || !touched) return;
+		if (mapped) {
+			discard(items, count);
+		} else {
+			std::memset(static_cast<void *>(items), 0, count*sizeof(T));
+		}
+		touched = false;
+	}
+
+	void assign(size_t n, const T &value) {
+		if (n != count) {
+			resize(n);
+			if (isZero(value)) return;  // fresh memory is already zero
+		}
+		if (isZero(value)) {
+			clear();
+		} else {
+			for (size_t i = 0; i < count; ++i) items[i] = value;
+			touched = true;
+		}
+	}
+
+	size_t size() const {
+		return count;
+	}
+	T * data() {
+		touched = true;
+		return items;
+	}
+	const T * data() const {
+		return items;
+	}
+	T & operator[](size_t i) {
+		touched = true;
+		return items[i];
+	}
+	const T & operator[](size_t i) const {
+		return items[i];
+	}
+};
@@ -0,0 +1,311 @@
+
+/*
+  ==============================================================================
+
+Two-stage pipeline for one FDN network: the audio thread runs the early
+reflections and pre-delay, a worker thread runs the diffuser and feedback
+loop, one block behind.
+
+For each sample the audio thread hands the pre-delayed early reflections to
+the worker, and takes back the worker's late output from `latency` samples
+earlier. So the wet output is the serial network's output delayed by
+`latency` samples. The engine delays the dry signal by the same amount and
+reports it to the host (ReverbEngine::getLatencySamples).
+
+Handing over:
+  - frames go through two preallocated rings (early to the worker, late back)
+  - at the end of each process call, the audio thread pushes a hand-off with
+    the frame count and the late half's settings, and wakes the worker
+  - a call of n samples needs the worker to have finished everything older
+    than n - latency samples back. Calls are never longer than `latency` (the
+    engine splits them), so that's always work from earlier calls, which the
+    worker had a whole block period for.
+
+If the worker is late anyway (descheduled, or running at normal priority
+because real-time priority was refused), the audio thread doesn't wait for it:
+the call leaves the rings alone and hands back silence, so the engine's output
+is dry only, and counts as a miss. Nothing is handed over for it, so the
+worker catches up. Offline renders have no deadline, and wait instead.
+
+The worker has its own BasicReverb, configured from the same seed, and only
+runs its diffuser, feedback and modulation. Settings reach it with each call,
+so it sees a change at the same sample the serial network would, and the
+output is the serial output, delayed. (A modulation retrigger is applied
+after the call's other settings, which is the order the processor sets them.)
+
+No JUCE in here.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "FDN_Reverb.h"
+#include "SpscRing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// The library feature macro, not __cplusplus: MSVC reports 199711L for that unless /Zc:__cplusplus
+#if __has_include(<version>)
+	#include <version>
+#endif
+
+#if defined(__cpp_lib_semaphore)
+	#include <semaphore>
+	#define REVERB_PIPELINE_STD_SEMAPHORE 1
+#elif defined(__APPLE__)
+	#include <dispatch/dispatch.h>
+#elif !defined(_WIN32)
+	#include <semaphore.h>
+#endif
+
+#if defined(__APPLE__) || defined(__linux__)
+	#include <pthread.h>
+	#include <sched.h>
+#elif defined(_WIN32)
+	// Semaphore (without the C++20 library) and thread priority
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#include <windows.h>
+#endif
+
+
+// Non-template part, for the engine's block handling
+class PipelineControl {
+public:
+	virtual ~PipelineControl() = default;
+
+	// Audio thread, around each process call (of at most getLatency() samples). Returns false if the
+	// worker is late: then the call goes out without the network. With `wait`, it waits instead.
+	virtual bool beginBlock(int numSamples, bool wait) = 0;
+	virtual void endBlock() = 0;
+
+	virtual int getLatency() const = 0;
+};
+
+
+// Wakes the worker. Signalling never blocks, so it's fine on the audio thread.
+class PipelineSemaphore {
+public:
+#if REVERB_PIPELINE_STD_SEMAPHORE
+	void signal() { semaphore.release(); }
+	void wait() { semaphore.acquire(); }
+private:
+	std::counting_semaphore<> semaphore{0};
+#elif defined(__APPLE__)
+	PipelineSemaphore() : semaphore(dispatch_semaphore_create(0)) {}
+	~PipelineSemaphore() { dispatch_release(semaphore); }
+	void signal() { dispatch_semaphore_signal(semaphore); }
+	void wait() { dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER); }
+private:
+	dispatch_semaphore_t semaphore;
+#elif defined(_WIN32)
+	PipelineSemaphore() : semaphore(CreateSemaphoreW(nullptr, 0, LONG_MAX, nullptr)) {}
+	~PipelineSemaphore() { CloseHandle(semaphore); }
+	void signal() { ReleaseSemaphore(semaphore, 1, nullptr); }
+	void wait() { WaitForSingleObject(semaphore, INFINITE); }
+private:
+	HANDLE semaphore;
+#else
+	PipelineSemaphore() { sem_init(&semaphore, 0, 0); }
+	~PipelineSemaphore() { sem_destroy(&semaphore); }
+	void signal() { sem_post(&semaphore); }
+	void wait() { while (sem_wait(&semaphore) != 0) {} }
+private:
+	sem_t semaphore;
+#endif
+};
+
+
+template<int channels, int diffusionSteps, int networks>
+class NetworkPipeline : public PipelineControl {
+	using Reverb = BasicReverb<channels, diffusionSteps, networks>;
+	using Array = typename Reverb::Array;
+
+public:
+	// Before each call, for the worker's network
+	struct Settings {
+		double roomSizeMs = 50, rt60 = 6, modulationDepthMs = 0, modulationRateHz = 0.5;
+		bool retrigger = false;
+	};
+
+	// Allocates, configures the worker's network and starts the worker
+	NetworkPipeline(int latencySamples, const Reverb& early, double sampleRate, uint32_t seed)
+		: latency(std::max(1, latencySamples))
+	{
+		size_t size = 1;
+		while (size < 2 * size_t(latency)) size *= 2;
+		mask = uint32_t(size - 1);
+		earlyFrames.assign(size, Array{});
+		lateFrames.assign(size, Array{});
+
+		// The first `latency` frames are the silence before the start
+		written = uint32_t(latency);
+		handedOver = written;
+		done.store(uint32_t(latency));
+
+		settings = settingsFrom(early);
+		apply(settings);
+		randomInRange::seed(seed);  // same random delays as the early half
+		late.configure(sampleRate);
+
+		worker = std::thread([this] { run(); });
+	}
+
+	~NetworkPipeline() override
+	{
+		stopping.store(true);
+		wake.signal();
+		worker.join();
+	}
+
+	int getLatency() const override { return latency; }
+
+	bool beginBlock(int numSamples, bool wait) override
+	{
+		const uint32_t needed = written + uint32_t(numSamples) - uint32_t(latency);
+		while (int32_t(done.load(std::memory_order_acquire) - needed) < 0)
+		{
+			if (!wait)
+			{
+				handOver();  // in case the last one didn't fit
+				skipping = true;
+				return false;
+			}
+			std::this_thread::yield();
+		}
+		skipping = false;
+		return true;
+	}
+
+	void endBlock() override
+	{
+		if (!skipping)
+			handOver();
+	}
+
+	// Audio thread, per sample: hands over the pre-delayed early reflections, and returns them
+	// and the late output from `latency` samples earlier. Silence while the worker is late.
+	void exchange(const Array& early, Array& delayedEarly, Array& longLasting)
+	{
+		if (skipping)
+		{
+			delayedEarly = Array{};
+			longLasting = Array{};
+			return;
+		}
+		earlyFrames[written & mask] = early;
+		const uint32_t read = (written - uint32_t(latency)) & mask;
+		delayedEarly = earlyFrames[read];
+		longLasting = lateFrames[read];
+		++written;
+	}
+
+	// Audio thread, with the early network's current values
+	void updateSettings(const Reverb& early)
+	{
+		const bool retrigger = settings.retrigger;
+		settings = settingsFrom(early);
+		settings.retrigger = retrigger;
+	}
+
+	void retriggerModulation() { settings.retrigger = true; }
+
+private:
+	struct Handoff {
+		uint32_t end = 0;  // frames written by the end of the call
+		Settings settings;
+	};
+
+	const int latency;
+	uint32_t mask = 0;
+	std::vector<Array> earlyFrames, lateFrames;
+	uint32_t written = 0;  // audio thread
+	uint32_t handedOver = 0;  // audio thread: `written` at the last hand-off
+	bool skipping = false;    // audio thread: the worker was late for this call
+	alignas(64) std::atomic<uint32_t> done{0};  // frames the worker has finished
+	SpscRing<Handoff, 256> handoffs;
+	Settings settings;  // audio thread, sent with the next hand-off
+
+	Reverb late;  // worker thread, once started
+	std::thread worker;
+	PipelineSemaphore wake;
+	std::atomic<bool> stopping{false};
+
+	static Settings settingsFrom(const Reverb& reverb)
+	{
+		Settings result;
+		result.roomSizeMs = reverb.roomSizeMs;
+		result.rt60 = reverb.rt60;
+		result.modulationDepthMs = reverb.modulation.depthMs;
+		result.modulationRateHz = reverb.modulation.rateHz;
+		return result;
+	}
+
+	// Audio thread. The ring is only full if the worker is far behind, and then the frames go with
+	// the next hand-off (the worker runs up to each one's end).
+	void handOver()
+	{
+		if (handedOver == written)
+			return;
+		if (handoffs.push({ written, settings }))
+		{
+			handedOver = written;
+			settings.retrigger = false;
+		}
+		wake.signal();
+	}
+
+	void apply(const Settings& newSettings)
+	{
+		late.setRoomSize(newSettings.roomSizeMs);
+		late.setDecay(newSettings.rt60);
+		late.setModulationDepth(newSettings.modulationDepthMs);
+		late.setModulationRate(newSettings.modulationRateHz);
+		if (newSettings.retrigger) late.retriggerModulation();
+	}
+
+	static void raisePriority()
+	{
+#if defined(__APPLE__)
+		pthread_set_qos_class_self_np(QOS_CLASS_USER_INTERACTIVE, 0);
+#elif defined(__linux__)
+		// Needs CAP_SYS_NICE or an rtkit grant, otherwise it stays at normal priority
+		sched_param param{};
+		param.sched_priority = sched_get_priority_min(SCHED_FIFO) + 1;
+		pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+#elif defined(_WIN32)
+		SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+#endif
+	}
+
+	void run()
+	{
+		raisePriority();
+		uint32_t position = done.load();
+		Handoff handoff;
+		while (true)
+		{
+			wake.wait();
+			if (stopping.load())
+				return;
+
+			while (handoffs.pop(handoff))
+			{
+				apply(handoff.settings);
+				for (; position != handoff.end; ++position)
+					lateFrames[position & mask] = late.processLate(earlyFrames[position & mask]);
+				done.store(position, std::memory_order_release);
+			}
+		}
+	}
+};
@@ -0,0 +1,89 @@
+
+/*
+  ==============================================================================
+
+Parameter events for the reverb engine.
+
+Parameter changes never touch the engine directly. PendingParameters collects
+them lock-free from any number of producer threads (the APVTS listener), and the
+audio thread applies them at the start of the next block.
+
+So automation is block-quantized: a change lands on the first sample of the
+block after it, and a render is repeatable for a given host block size. JUCE's
+plugin wrappers only hand over the last value of each parameter per block (the
+VST3 sample offsets are dropped before processBlock), so there's nothing to
+split the block at. Size and decay glide over ~50 ms in the engine anyway.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+
+// Engine parameters. Order matches the parameter layout in the processor.
+enum class ParamId : int {
+	size = 0,
+	decay,
+	dry,
+	diffuser,
+	wetReflections,
+	preDelay,
+	modRate,
+	modDepth,
+	modSync,
+	modNote,
+	modRetrigger,
+	stereoMode,
+	pipeline,
+	sharedEngine,
+	sharedSend,
+	count
+};
+
+constexpr int numParams = static_cast<int>(ParamId::count);
+
+// APVTS parameter IDs, indexed by ParamId
+constexpr std::array<const char*, numParams> paramIdStrings = {
+	"SIZE",
+	"DECAY",
+	"DRY",
+	"DIFFUSSER",
+	"WET_REFLECTIONS",
+	"PREDELAY",
+	"MOD_RATE",
+	"MOD_DEPTH",
+	"MOD_SYNC",
+	"MOD_NOTE",
+	"MOD_RETRIGGER",
+	"STEREO_MODE",
+	"PIPELINE",
+	"SHARED_ENGINE",
+	"SHARED_SEND"
+};
+
+
+// Latest value per parameter, written from any thread and read by the audio thread.
+struct PendingParameters {
+	std::array<std::atomic<float>, numParams> values{};
+	std::atomic<uint32_t> dirtyMask{0};
+
+	void set(ParamId id, float value) {
+		int index = static_cast<int>(id);
+		values[index].store(value, std::memory_order_relaxed);
+		dirtyMask.fetch_or(1u << index, std::memory_order_release);
+	}
+
+	// Calls apply(id, value) for every parameter changed since the last call
+	template<class Apply>
+	void drain(Apply &&apply) {
+		uint32_t mask = dirtyMask.exchange(0, std::memory_order_acquire);
+		for (int i = 0; mask != 0; ++i, mask >>= 1) {
+			if (mask & 1u) apply(static_cast<ParamId>(i), values[i].load(std::memory_order_relaxed));
+		}
+	}
+};
+
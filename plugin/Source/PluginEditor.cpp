@@ -4,18 +4,39 @@
 
 AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor(
     AudioPluginAudioProcessor& p)
-    : AudioProcessorEditor(&p), processorRef(p) {
-  juce::ignoreUnused(processorRef);
+    : AudioProcessorEditor(&p), processorRef(p), parameterEditor(p) {
+  addAndMakeVisible(parameterEditor);
+
+  // Whatever was measured while the editor was closed is stale
+  loadHistory.drain(processorRef.getCpuMeter());
+  loadHistory.clear();
+
   // Make sure that before the constructor has finished, you've set the
   // editor's size to whatever you need it to be.
-  setSize(400, 300);
+  setSize(juce::jmax(400, parameterEditor.getWidth()), parameterEditor.getHeight() + meterHeight);
 
 //button = ImageCache::getFromMemory(BinaryData::BgLarge_png, BinaryData::BgLarge_pngSize);
-  
+
+  startTimerHz(repaintHz);
 }
 
 AudioPluginAudioProcessorEditor::~AudioPluginAudioProcessorEditor() {}
 
+void AudioPluginAudioProcessorEditor::timerCallback() {
+  auto& meter = processorRef.getCpuMeter();
+  loadHistory.drain(meter);
+  currentLoad = meter.currentLoad.load(std::memory_order_relaxed);
+  deadlineMisses = meter.deadlineMisses.load(std::memory_order_relaxed);
+  loadSummary = loadHistory.summary();
+  engineDescription = processorRef.getEngineDescription();
+#if REVERB_STAGE_TIMING
+  stageTiming = processorRef.getStageTimingSummary();
+#endif
+
+  // Only the strip changes
+  repaint(meterArea);
+}
+
 void AudioPluginAudioProcessorEditor::paint(juce::Graphics& g) {
   // (Our component is opaque, so we must completely fill the background with a
   // solid colour)
@@ -24,13 +45,50 @@ void AudioPluginAudioProcessorEditor::paint(juce::Graphics& g) {
 
     //g.drawImageWithin(button, 0, 0, getWidth(), getHeight(), RectanglePlacement::stretchToFit, false);
 
+  auto area = meterArea.reduced(8, 6);
+  auto percent = [](float load) { return juce::String(load * 100.0f, 1) + "%"; };
+
+  // Bar: current load, with a tick at the p99. Full width is the whole deadline.
+  auto bar = area.removeFromTop(14).toFloat();
+  g.setColour(juce::Colours::black.withAlpha(0.4f));
+  g.fillRect(bar);
+
+  const auto colour = currentLoad < 0.5f ? juce::Colours::limegreen
+                    : currentLoad < 0.8f ? juce::Colours::orange
+                                         : juce::Colours::red;
+  g.setColour(colour);
+  g.fillRect(bar.withWidth(bar.getWidth() * juce::jlimit(0.0f, 1.0f, currentLoad)));
+
   g.setColour(juce::Colours::white);
-  g.setFont(15.0f);
-  g.drawFittedText("Hello to you World!", getLocalBounds(),
-                   juce::Justification::centred, 1);
+  const float p99X = bar.getX() + bar.getWidth() * juce::jlimit(0.0f, 1.0f, loadSummary.p99);
+  g.drawVerticalLine(juce::roundToInt(p99X), bar.getY(), bar.getBottom());
+
+  g.setFont(13.0f);
+  area.removeFromTop(4);
+  g.drawText("CPU " + percent(currentLoad) + " of deadline    peak " + percent(loadSummary.peak)
+                 + "    p99 " + percent(loadSummary.p99) + "  (last " + juce::String(juce::roundToInt(historySeconds)) + " s)"
+                 + "    missed " + juce::String(deadlineMisses),
+             area.removeFromTop(14), juce::Justification::centredLeft);
+  g.drawText("Engine: " + engineDescription, area.removeFromTop(14), juce::Justification::centredLeft);
+
+#if REVERB_STAGE_TIMING
+  // Ticks per sample (cycles on x86, ns elsewhere), mean/p99 over the recent blocks
+  juce::String stages = "Stages";
+  for (int s = 0; s < stageCount; ++s)
+  {
+    const auto& stat = stageTiming.stages[size_t(s)];
+    stages << "    " << stageNames[size_t(s)] << " " << juce::String(stat.mean, 1) << "/" << juce::String(stat.p99, 1);
+  }
+  if (stageTiming.dropped > 0)
+    stages << "    dropped " << juce::String(stageTiming.dropped);
+  g.drawText(stages, area.removeFromTop(14), juce::Justification::centredLeft);
+#endif
 }
 
 void AudioPluginAudioProcessorEditor::resized() {
   // This is generally where you'll want to lay out the positions of any
   // subcomponents in your editor..
+  auto area = getLocalBounds();
+  meterArea = area.removeFromBottom(meterHeight);
+  parameterEditor.setBounds(area);
 }
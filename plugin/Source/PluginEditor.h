@@ -6,8 +6,11 @@
 
 
 
-
-class AudioPluginAudioProcessorEditor : public juce::AudioProcessorEditor {
+// The generic parameter sliders, with a CPU meter strip underneath: processBlock time as a
+// share of the block deadline (now, and peak/p99 over the last few seconds), and which engine
+// the bus layout selected. Built with REVERB_STAGE_TIMING, also the time per sample in each
+// network stage (StageTiming.h).
+class AudioPluginAudioProcessorEditor : public juce::AudioProcessorEditor, private juce::Timer {
 public:
   explicit AudioPluginAudioProcessorEditor(AudioPluginAudioProcessor&);
   ~AudioPluginAudioProcessorEditor() override;
@@ -16,10 +19,28 @@ public:
   void resized() override;
 
 private:
+  void timerCallback() override;
+
   // This reference is provided as a quick way for your editor to
   // access the processor object that created it.
   AudioPluginAudioProcessor& processorRef;
 
+  juce::GenericAudioProcessorEditor parameterEditor;
+
+  // CPU meter (message thread only)
+  static constexpr int meterHeight = REVERB_STAGE_TIMING ? 70 : 56;
+  static constexpr int repaintHz = 20;
+  static constexpr double historySeconds = 5.0;
+  CpuLoadHistory loadHistory{historySeconds};
+  float currentLoad = 0.0f;
+  uint32_t deadlineMisses = 0;
+  CpuLoadHistory::Summary loadSummary;
+  juce::String engineDescription;
+#if REVERB_STAGE_TIMING
+  StageTimingStats::Summary stageTiming;
+#endif
+  juce::Rectangle<int> meterArea;
+
   //Image button; 
    
 
@@ -27,4 +48,3 @@ private:
 
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AudioPluginAudioProcessorEditor)
 };
-
@@ -1,3 +1,5 @@
+// Replaces operator new/delete here when built with REVERB_RT_CHECKS (RealtimeChecks.h)
+#define REVERB_RT_CHECKS_IMPLEMENTATION
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 
@@ -13,22 +15,17 @@ AudioPluginAudioProcessor::AudioPluginAudioProcessor()
       ), apvts(*this, nullptr, "Parameters", createParameterLayout()) {
     
     // Register the processor as a listener to the parameters
-    apvts.addParameterListener("SIZE", this);
-    apvts.addParameterListener("DECAY", this);
-    apvts.addParameterListener("DRY", this);
-    apvts.addParameterListener("DIFFUSSER", this);
-    apvts.addParameterListener("WET_REFLECTIONS", this);
-    apvts.addParameterListener("PREDELAY", this);
+    for (auto* paramID : paramIdStrings)
+        apvts.addParameterListener(paramID, this);
+
+    startTimerHz(10);
 }
 
 AudioPluginAudioProcessor::~AudioPluginAudioProcessor() 
 {
-    apvts.removeParameterListener("SIZE", this);
-    apvts.removeParameterListener("DECAY", this);
-    apvts.removeParameterListener("DRY", this);
-    apvts.removeParameterListener("DIFFUSSER", this);
-    apvts.removeParameterListener("WET_REFLECTIONS", this);
-    apvts.removeParameterListener("PREDELAY", this);
+    stopTimer();
+    for (auto* paramID : paramIdStrings)
+        apvts.removeParameterListener(paramID, this);
 }
 
 const juce::String AudioPluginAudioProcessor::getName() const {
@@ -93,9 +90,149 @@ void AudioPluginAudioProcessor::prepareToPlay(double sampleRate,
   // initialisation that you need..
   juce::ignoreUnused(sampleRate, samplesPerBlock);
 
-  reverb.configure(sampleRate);
+  currentSampleRate = sampleRate;
+  maxBlockSize = samplesPerBlock;
+  cancelPendingUpdate();
+  sharedMember.reset();  // leaves its group before joining again
+  sharedMember = joinSharedEngine();
+  engine = (sharedMember != nullptr) ? nullptr : buildEngine();
+  publishEngineInfo();
+  setLatencySamples(getEngineLatency());
+
+  // The engine starts from its own defaults, so push every current value through
+  for (int i = 0; i < numParams; ++i)
+      pendingParameters.set(static_cast<ParamId>(i), apvts.getRawParameterValue(paramIdStrings[i])->load());
+}
+
+// Allocates, so never on the audio thread
+std::unique_ptr<GovernedReverbEngine> AudioPluginAudioProcessor::buildEngine() const
+{
+    // Pick the network for the current layout. The LFE channel (if any) only gets dry signal.
+    const auto layout = getBus(false, 0)->getCurrentLayout();
+    const auto stereoMode = static_cast<StereoMode>(juce::roundToInt(apvts.getRawParameterValue("STEREO_MODE")->load()));
+    const bool pipelined = apvts.getRawParameterValue("PIPELINE")->load() >= 0.5f;
+
+    // Ambisonic layouts report their order, speaker layouts report -1.
+    auto newEngine = createGovernedReverbEngine(layout.size(), layout.getChannelIndexForType(juce::AudioChannelSet::LFE),
+                                        layout.getAmbisonicOrder(), stereoMode);
+    newEngine->setSeed(engineSeed.load());
+    newEngine->setOffline(offlineRender.load());
+    // One host block of latency: the worker runs the late network while the host does other work
+    newEngine->setPipelineBlockSize(pipelined ? maxBlockSize : 0);
+    newEngine->configure(currentSampleRate);
+    return newEngine;
+}
+
+// Null if the SHARED_ENGINE parameter is off, or the group is full
+std::unique_ptr<SharedReverbMember> AudioPluginAudioProcessor::joinSharedEngine() const
+{
+    SharedReverbKey key;
+    key.engineId = juce::roundToInt(apvts.getRawParameterValue("SHARED_ENGINE")->load());
+    if (key.engineId <= 0 || maxBlockSize <= 0)
+        return nullptr;
+
+    const auto layout = getBus(false, 0)->getCurrentLayout();
+    key.numHostChannels = layout.size();
+    key.lfeChannel = layout.getChannelIndexForType(juce::AudioChannelSet::LFE);
+    key.ambisonicOrder = layout.getAmbisonicOrder();
+    key.stereoMode = static_cast<StereoMode>(juce::roundToInt(apvts.getRawParameterValue("STEREO_MODE")->load()));
+    key.sampleRate = currentSampleRate;
+    key.maxBlockSize = maxBlockSize;
+    return SharedReverbRegistry::instance().join(key, engineSeed.load());
+}
+
+int AudioPluginAudioProcessor::getEngineLatency() const
+{
+    if (sharedMember != nullptr)
+        return sharedMember->getLatencySamples();
+    return (engine != nullptr) ? engine->getLatencySamples() : 0;
+}
+
+// Stereo mode, pipelining, shared engine or seed changed: build the new engine here, then swap it in
+// under the callback lock
+void AudioPluginAudioProcessor::handleAsyncUpdate()
+{
+    if (currentSampleRate <= 0.0)
+        return;  // not prepared yet, prepareToPlay will pick it up
+
+    auto newMember = joinSharedEngine();
+    auto newEngine = (newMember != nullptr) ? nullptr : buildEngine();
+    {
+        const juce::ScopedLock lock(getCallbackLock());
+        std::swap(engine, newEngine);
+        std::swap(sharedMember, newMember);
+    }
+    publishEngineInfo();
+    setLatencySamples(getEngineLatency());
+    // The old engine (or membership) is freed here, on the message thread
+
+    for (int i = 0; i < numParams; ++i)
+        pendingParameters.set(static_cast<ParamId>(i), apvts.getRawParameterValue(paramIdStrings[i])->load());
+}
+
+// Hosts usually call this before prepareToPlay for a bounce, but not always, so a running
+// engine crossfades to the offline tier once the timer has built it. Any thread: the engine may
+// be swapped meanwhile, so the audio thread passes the mode on with the next block.
+void AudioPluginAudioProcessor::setNonRealtime(bool isNonRealtime) noexcept
+{
+    AudioProcessor::setNonRealtime(isNonRealtime);
+    offlineRender.store(isNonRealtime);
+}
 
-  
+// Same thread as handleAsyncUpdate. Builds the tiers the governor asks for, and clears faded-out
+// ones. The audio thread doesn't touch a tier until it's built, or while it's stale.
+void AudioPluginAudioProcessor::timerCallback()
+{
+    if (engine != nullptr)
+        engine->maintain();
+}
+
+#if REVERB_STAGE_TIMING
+// Same thread as handleAsyncUpdate, so the engine can't be swapped underneath
+StageTimingStats::Summary AudioPluginAudioProcessor::getStageTimingSummary()
+{
+    if (engine != nullptr)
+        stageTimingStats.drain(engine->getStageTimer());
+    return stageTimingStats.summary();
+}
+#endif
+
+// For the editor, which can't look at the engine while it may be swapped
+void AudioPluginAudioProcessor::publishEngineInfo()
+{
+    if (sharedMember != nullptr)
+    {
+        const auto &group = sharedMember->getGroup();
+        engineName.store(group.getName());
+        engineNetworkChannels.store(group.getNetworkChannels());
+        engineTier.store(static_cast<int>(EngineTier::full));
+        sharedEngineId.store(group.key.engineId);
+        sharedReturn.store(sharedMember->isReturn());
+        return;
+    }
+
+    sharedEngineId.store(0);
+    engineName.store(engine->getName());
+    engineNetworkChannels.store(engine->getNetworkChannels());
+    engineTier.store(static_cast<int>(engine->getTier()));
+}
+
+juce::String AudioPluginAudioProcessor::getEngineDescription() const
+{
+    const int networkChannels = engineNetworkChannels.load();
+    if (networkChannels == 0)
+        return "Not prepared";
+
+    auto description = juce::String(engineName.load()) + ", " + juce::String(networkChannels) + "-channel FDN";
+    if (const int sharedId = sharedEngineId.load(); sharedId > 0)
+        return description + ", shared engine " + juce::String(sharedId) + (sharedReturn.load() ? " (return)" : " (send)");
+    switch (static_cast<EngineTier>(engineTier.load()))
+    {
+        case EngineTier::high:    return description + " (offline quality)";
+        case EngineTier::reduced: return description + " (reduced quality)";
+        case EngineTier::minimal: return description + " (minimal quality)";
+        default:                  return description;
+    }
 }
 
 void AudioPluginAudioProcessor::releaseResources() {
@@ -109,12 +246,21 @@ bool AudioPluginAudioProcessor::isBusesLayoutSupported(
   juce::ignoreUnused(layouts);
   return true;
 #else
-  // This is the place where you check if the layout is supported.
-  // In this template code we only support mono or stereo.
+  // Mono and stereo go through the stereo upmix, the surround layouts map
+  // straight onto the network channels, and Ambisonics (AmbiX, up to 3rd
+  // order) are encoded from the network channels (see ReverbEngine.h).
   // Some plugin hosts, such as certain GarageBand versions, will only
   // load plugins that support stereo bus layouts.
-  if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono() &&
-      layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+  const auto output = layouts.getMainOutputChannelSet();
+  if (output != juce::AudioChannelSet::mono() &&
+      output != juce::AudioChannelSet::stereo() &&
+      output != juce::AudioChannelSet::quadraphonic() &&
+      output != juce::AudioChannelSet::create5point1() &&
+      output != juce::AudioChannelSet::create7point1() &&
+      output != juce::AudioChannelSet::create7point1point4() &&
+      output != juce::AudioChannelSet::ambisonic(1) &&
+      output != juce::AudioChannelSet::ambisonic(2) &&
+      output != juce::AudioChannelSet::ambisonic(3))
     return false;
 
     // This checks if the input layout matches the output layout
@@ -130,14 +276,97 @@ bool AudioPluginAudioProcessor::isBusesLayoutSupported(
 void AudioPluginAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
     juce::ignoreUnused(midiMessages);
+    processSamples(buffer);
+}
 
+void AudioPluginAudioProcessor::processBlock(juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages)
+{
+    juce::ignoreUnused(midiMessages);
+    processSamples(buffer);
+}
+
+template<typename Sample>
+void AudioPluginAudioProcessor::processSamples(juce::AudioBuffer<Sample>& buffer)
+{
     juce::ScopedNoDenormals noDenormals;
 
-    auto* channelDataL = buffer.getWritePointer(0);
-    auto* channelDataR = buffer.getWritePointer(1);
+    if (engine == nullptr && sharedMember == nullptr)
+        return;
+
+    REVERB_TRACE_SCOPE("processBlock");
+    REVERB_RT_SCOPE();
+    const int numSamples = buffer.getNumSamples();
+    cpuMeter.begin();
+
+    // Changes have no position within the block, they apply from its start (see ParameterEvents.h)
+    pendingParameters.drain([this](ParamId id, float value) { applyParameter(id, value); });
+    if (engine != nullptr)
+        engine->setOffline(offlineRender.load(std::memory_order_relaxed));
+    updateFromPlayHead();
 
-    reverb.process(channelDataL, channelDataR, buffer.getNumSamples());
-      
+    // Float buffers are converted inside the engine, double buffers are processed directly
+    std::array<Sample*, ReverbEngine::maxChannels> channels{};
+    const int numChannels = juce::jmin(buffer.getNumChannels(), ReverbEngine::maxChannels);
+
+    for (int ch = 0; ch < numChannels; ++ch)
+        channels[static_cast<size_t>(ch)] = buffer.getWritePointer(ch);
+
+    if (sharedMember != nullptr)
+        sharedMember->process(channels.data(), numSamples);
+    else
+        engine->process(channels.data(), numSamples);
+
+    // May start a crossfade to another tier from the next block
+    const float load = cpuMeter.end(numSamples, currentSampleRate);
+    if (sharedMember != nullptr)
+    {
+        sharedReturn.store(sharedMember->isReturn(), std::memory_order_relaxed);
+        return;
+    }
+    // A pipeline worker that wasn't done in time left the block dry: that's a miss too
+    if (const int pipelineMisses = engine->takePipelineMisses(); pipelineMisses > 0)
+        cpuMeter.deadlineMisses.fetch_add(static_cast<uint32_t>(pipelineMisses), std::memory_order_relaxed);
+    engine->reportLoad(load, numSamples / currentSampleRate);
+    engineNetworkChannels.store(engine->getNetworkChannels(), std::memory_order_relaxed);
+    engineTier.store(static_cast<int>(engine->getTier()), std::memory_order_relaxed);
+}
+
+// Reads the host timeline once per block, for tempo sync and retrigger of the modulation LFOs
+void AudioPluginAudioProcessor::updateFromPlayHead()
+{
+    double bpm = 0.0;
+    bool playing = false;
+
+    if (auto* playHead = getPlayHead())
+    {
+        if (auto position = playHead->getPosition())
+        {
+            if (auto hostBpm = position->getBpm())
+                bpm = *hostBpm;
+
+            playing = position->getIsPlaying();
+        }
+    }
+
+    // Re-derived every block, so synced rates follow tempo changes
+    double rateHz = modRateHz;
+    if (modSync && bpm > 0.0)
+        rateHz = bpm / 60.0 / modNoteBeats[static_cast<size_t>(modNote)];
+
+    if (sharedMember != nullptr)
+        sharedMember->setModulationRate(rateHz);
+    else
+        engine->setModulationRate(rateHz);
+
+    if (modRetrigger && playing && !wasPlaying)
+    {
+        if (sharedMember != nullptr)
+            sharedMember->retriggerModulation();
+        else
+            engine->retriggerModulation();
+    }
+
+    wasPlaying = playing;
 }
 
 bool AudioPluginAudioProcessor::hasEditor() const {
@@ -145,46 +374,92 @@ bool AudioPluginAudioProcessor::hasEditor() const {
 }
 
 juce::AudioProcessorEditor* AudioPluginAudioProcessor::createEditor() {
-  return new juce::GenericAudioProcessorEditor(*this);
+  return new AudioPluginAudioProcessorEditor(*this);
 }
 
 void AudioPluginAudioProcessor::getStateInformation(
     juce::MemoryBlock& destData) {
-  
-    
-    juce::ValueTree params("Params");
-
-    for (auto& param : getParameters())
-    {
-        juce::ValueTree paramTree(getParamID(param));
-        paramTree.setProperty("Value", param->getValue(), nullptr);
-        params.appendChild(paramTree, nullptr);
-    }
-
-
-    copyXmlToBinary(*params.createXml(), destData);
 
+    // Binary layout, see PluginState.h
+    PluginState state;
+    state.seed = engineSeed.load();
+    for (int i = 0; i < numParams; ++i)
+        state.values[i] = apvts.getParameter(paramIdStrings[i])->getValue();
 
+    std::vector<uint8_t> bytes;
+    state.write(bytes);
+    destData.replaceAll(bytes.data(), bytes.size());
 }
 
+// Restores as one transaction: parse everything, hand the engine the whole snapshot as a single
+// batch, then update the parameters and host without going back through parameterChanged.
 void AudioPluginAudioProcessor::setStateInformation(const void* data, int sizeInBytes) 
 {
+    // Parse (normalised values)
+    PluginState state;
+    auto& values = state.values;
+    auto& found = state.found;
 
+    const bool binary = state.read(data, static_cast<size_t>(sizeInBytes));
+    if (!binary)
+    {
+        // Sessions saved before the binary format. A binary state of another version, or cut short,
+        // isn't XML either, so it changes nothing.
+        auto xml = getXmlFromBinary(data, sizeInBytes);
 
-    auto xml = getXmlFromBinary(data, sizeInBytes);
+        if (xml == nullptr)
+            return;
 
-    if (xml != nullptr)
-    {
         auto preset = juce::ValueTree::fromXml(*xml);
-
-        for (auto& param : getParameters())
+        for (int i = 0; i < numParams; ++i)
         {
-            auto paramTree = preset.getChildWithName(getParamID(param));
-
+            auto paramTree = preset.getChildWithName(paramIdStrings[i]);
             if (paramTree.isValid())
-                param->setValueNotifyingHost(paramTree["Value"]);
+            {
+                values[i] = static_cast<float>(paramTree["Value"]);
+                found[i] = true;
+            }
         }
     }
+
+    for (int i = 0; i < numParams; ++i)
+    {
+        if (found[i])
+        {
+            found[i] = std::isfinite(values[i]);
+            values[i] = juce::jlimit(0.0f, 1.0f, values[i]);
+        }
+    }
+
+    // Engine: the pending values are applied together at the start of the next block
+    std::array<float, numParams> oldValues{};
+    for (int i = 0; i < numParams; ++i)
+        oldValues[i] = apvts.getRawParameterValue(paramIdStrings[i])->load();
+    for (int i = 0; i < numParams; ++i)
+    {
+        if (found[i])
+            pendingParameters.set(static_cast<ParamId>(i), apvts.getParameter(paramIdStrings[i])->convertFrom0to1(values[i]));
+    }
+
+    // Parameters and host. The engine already has these values, so the listener skips them.
+    restoringState.store(true);
+    for (int i = 0; i < numParams; ++i)
+    {
+        if (found[i])
+            apvts.getParameter(paramIdStrings[i])->setValueNotifyingHost(values[i]);
+    }
+    restoringState.store(false);
+
+    // A different seed, or a changed parameter in needsNewEngine(), needs a different engine, built once
+    // the parameters are in place. XML states have no seed, so they keep the current one.
+    bool rebuild = binary && engineSeed.exchange(state.seed) != state.seed;
+    for (int i = 0; i < numParams; ++i)
+    {
+        if (needsNewEngine(static_cast<ParamId>(i)) && apvts.getRawParameterValue(paramIdStrings[i])->load() != oldValues[i])
+            rebuild = true;
+    }
+    if (rebuild)
+        triggerAsyncUpdate();
 }
 
 
@@ -244,6 +519,53 @@ juce::AudioProcessorValueTreeState::ParameterLayout AudioPluginAudioProcessor::c
         })); // default
 
 
+    // Delay modulation
+    params.push_back(std::make_unique<juce::AudioParameterFloat>("MOD_RATE",
+        "Modulation Rate",
+        juce::NormalisableRange<float>(0.05f, 5.0f, 0.01f, 0.5f), 0.5f, String(), AudioProcessorParameter::genericParameter,
+        [](float value, int) -> String
+        {
+            return String(value, 2) + " Hz";
+        }));
+
+    params.push_back(std::make_unique<juce::AudioParameterFloat>("MOD_DEPTH",
+        "Modulation Depth",
+        juce::NormalisableRange<float>(0.0f, 5.0f, 0.01f), 0.0f, String(), AudioProcessorParameter::genericParameter,
+        [](float value, int) -> String
+        {
+            return String(value, 2) + " ms";
+        })); // default: off
+
+    params.push_back(std::make_unique<juce::AudioParameterBool>("MOD_SYNC",
+        "Modulation Sync", false));
+
+    params.push_back(std::make_unique<juce::AudioParameterChoice>("MOD_NOTE",
+        "Modulation Note",
+        juce::StringArray { "4 bars", "2 bars", "1 bar", "1/2", "1/4", "1/8", "1/16" }, 2));
+
+    params.push_back(std::make_unique<juce::AudioParameterBool>("MOD_RETRIGGER",
+        "Modulation Retrigger", false));
+
+    // Stereo buses only. Binaural renders the tail for headphones, true stereo
+    // keeps the left/right input position in the tail.
+    params.push_back(std::make_unique<juce::AudioParameterChoice>("STEREO_MODE",
+        "Stereo Mode",
+        juce::StringArray { "Stereo", "Binaural", "True Stereo" }, 0));
+
+    // Runs the late half of the network on a worker thread, for one block of latency
+    params.push_back(std::make_unique<juce::AudioParameterBool>("PIPELINE",
+        "Pipelined Processing", false));
+
+    // Instances with the same ID feed one shared engine, like a send to a reverb bus (SharedReverb.h)
+    params.push_back(std::make_unique<juce::AudioParameterInt>("SHARED_ENGINE",
+        "Shared Engine", 0, 16, 0, String(),
+        [](int value, int) -> String
+        {
+            return (value == 0) ? String("Off") : String(value);
+        }));
+
+    params.push_back(std::make_unique<juce::AudioParameterFloat>("SHARED_SEND",
+        "Shared Send", juce::NormalisableRange<float>(0.0f, 1.0f, 0.01f), 1.0f));
 
     
 
@@ -252,34 +574,54 @@ juce::AudioProcessorValueTreeState::ParameterLayout AudioPluginAudioProcessor::c
 
 void AudioPluginAudioProcessor::parameterChanged(const juce::String& parameterID, float newValue) 
 {
-    if (parameterID == "SIZE")
-    {
-        reverb.setRoomSize(newValue);
+    // setStateInformation has already handed these values to the engine
+    if (restoringState.load())
+        return;
 
-    }
-    else if (parameterID == "DECAY")
+    // May be called from any thread, so only record it. The audio thread applies it.
+    for (int i = 0; i < numParams; ++i)
     {
-        reverb.setDecay(newValue);
-       
+        if (parameterID == paramIdStrings[i])
+        {
+            pendingParameters.set(static_cast<ParamId>(i), newValue);
+            if (needsNewEngine(static_cast<ParamId>(i)))
+                triggerAsyncUpdate();
+            return;
+        }
     }
+}
 
-    else if (parameterID == "DRY")
-    {
-       reverb.setDry(newValue);
-    }
+// Parameters that pick the engine rather than set it, see handleAsyncUpdate
+bool AudioPluginAudioProcessor::needsNewEngine(ParamId id)
+{
+    return id == ParamId::stereoMode || id == ParamId::pipeline || id == ParamId::sharedEngine;
+}
 
-    else if (parameterID == "DIFFUSSER") 
-    {
-        reverb.setDiffusionGain(newValue);
-    }
+void AudioPluginAudioProcessor::applyParameter(ParamId id, float value)
+{
+    REVERB_TRACE_VALUE(paramIdStrings[static_cast<int>(id)], value);
 
-    else if (parameterID == "WET_REFLECTIONS") 
-    {
-        reverb.setEarlyReflections(newValue);
-    }
+    // Shared: the member keeps dry and send, and passes the rest on while it's the group's return
+    if (sharedMember != nullptr && sharedMember->setParameter(id, value))
+        return;
 
-    else if (parameterID == "PREDELAY")
+    switch (id)
     {
-        reverb.setPreDelay(newValue);
+        case ParamId::size:           engine->setRoomSize(value); break;
+        case ParamId::decay:          engine->setDecay(value); break;
+        case ParamId::dry:            engine->setDry(value); break;
+        case ParamId::diffuser:       engine->setDiffusionGain(value); break;
+        case ParamId::wetReflections: engine->setEarlyReflections(value); break;
+        case ParamId::preDelay:       engine->setPreDelay(value); break;
+        case ParamId::modRate:        modRateHz = value; break;
+        case ParamId::modDepth:       engine->setModulationDepth(value); break;
+        case ParamId::modSync:        modSync = value >= 0.5f; break;
+        case ParamId::modNote:        modNote = juce::jlimit(0, static_cast<int>(modNoteBeats.size()) - 1, juce::roundToInt(value)); break;
+        case ParamId::modRetrigger:   modRetrigger = value >= 0.5f; break;
+        case ParamId::stereoMode:     break;  // needs a different engine, see handleAsyncUpdate
+        case ParamId::pipeline:       break;  // same
+        case ParamId::sharedEngine:   break;  // same
+        case ParamId::sharedSend:     break;  // only used by a shared engine member
+        default: break;
     }
-}
\ No newline at end of file
+}
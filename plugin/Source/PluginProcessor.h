@@ -1,12 +1,17 @@
 #pragma once
 
 #include <JuceHeader.h>
-#include "FDN_Reverb.h"
+#include "QualityGovernor.h"
+#include "SharedReverb.h"
+#include "ParameterEvents.h"
+#include "PluginState.h"
+#include "CpuMeter.h"
 #include "mix.h"
 
 //#include <juce_audio_processors/juce_audio_processors.h>
 
-class AudioPluginAudioProcessor : public juce::AudioProcessor, public juce::AudioProcessorValueTreeState::Listener {
+class AudioPluginAudioProcessor : public juce::AudioProcessor, public juce::AudioProcessorValueTreeState::Listener,
+                                  private juce::AsyncUpdater, private juce::Timer {
 public:
 	AudioPluginAudioProcessor();
 	~AudioPluginAudioProcessor() override;
@@ -16,8 +21,13 @@ public:
 
 	bool isBusesLayoutSupported(const BusesLayout& layouts) const override;
 
+	// The engine runs in double, so 64-bit hosts go straight through without conversion
 	void processBlock(juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
-	using AudioProcessor::processBlock;
+	void processBlock(juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
+	bool supportsDoublePrecisionProcessing() const override { return true; }
+
+	// Offline renders use the heavier engine tier
+	void setNonRealtime(bool isNonRealtime) noexcept override;
 
 	juce::AudioProcessorEditor* createEditor() override;
 	bool hasEditor() const override;
@@ -46,12 +56,50 @@ public:
 	void getStateInformation(juce::MemoryBlock& destData) override;
 	void setStateInformation(const void* data, int sizeInBytes) override;
 
-	
+	// processBlock time against the block duration. The editor drains its records.
+	CpuMeter& getCpuMeter() { return cpuMeter; }
+
+	// Which engine the bus layout and stereo mode selected, e.g. "Stereo, 8-channel FDN", plus the
+	// quality tier if the governor has stepped down, or the shared engine this instance feeds
+	juce::String getEngineDescription() const;
+
+#if REVERB_STAGE_TIMING
+	// Message thread: drains the engine's timing records, then min/mean/p99 per stage
+	StageTimingStats::Summary getStageTimingSummary();
+#endif
+
 
 private:
 	
  		 //  <channels,diffusion steps>	
-	BasicReverb<8, 4> reverb = BasicReverb<8, 4>();
+	// Network size and channel mapping depend on the bus layout, so this is built in prepareToPlay
+	// (and rebuilt on the message thread when the stereo mode or pipelining changes). One engine per quality
+	// tier, switched under CPU pressure (QualityGovernor.h).
+	std::unique_ptr<GovernedReverbEngine> engine;
+	std::unique_ptr<GovernedReverbEngine> buildEngine() const;
+	// With a shared engine ID, the instance feeds a process-wide engine instead (SharedReverb.h),
+	// and has no engine of its own
+	std::unique_ptr<SharedReverbMember> sharedMember;
+	std::unique_ptr<SharedReverbMember> joinSharedEngine() const;
+	int getEngineLatency() const;
+	static bool needsNewEngine(ParamId id);
+	void handleAsyncUpdate() override;
+	void timerCallback() override;  // clears the tails of tiers the governor switched away from
+	double currentSampleRate = 0.0;
+	int maxBlockSize = 0;
+	std::atomic<uint32_t> engineSeed{std::random_device{}()};  // saved with the state
+	std::atomic<bool> offlineRender{false};  // from setNonRealtime, passed to the engine by the audio thread
+	void publishEngineInfo();
+	std::atomic<const char*> engineName{""};
+	std::atomic<int> engineNetworkChannels{0};
+	std::atomic<int> engineTier{0};
+	std::atomic<int> sharedEngineId{0};
+	std::atomic<bool> sharedReturn{false};
+	CpuMeter cpuMeter;
+
+#if REVERB_TRACE
+	Trace::Session traceSession;  // writes the trace file while any instance exists
+#endif
 
 	// Parameters
 	juce::AudioProcessorValueTreeState apvts;
@@ -63,6 +111,27 @@ private:
 	// Listener callback when parameters change
 	void parameterChanged(const juce::String& parameterID, float newValue) override;
 
+	// Audio thread only
+	void applyParameter(ParamId id, float value);
+	void updateFromPlayHead();
+	template<typename Sample>
+	void processSamples(juce::AudioBuffer<Sample>& buffer);
+
+	PendingParameters pendingParameters;  // applied per block, see ParameterEvents.h
+	std::atomic<bool> restoringState{false};  // setStateInformation is updating the parameters
+
+#if REVERB_STAGE_TIMING
+	StageTimingStats stageTimingStats;
+#endif
+
+	// Modulation LFO, tempo sync and retrigger (audio thread)
+	static constexpr std::array<double, 7> modNoteBeats = { 16.0, 8.0, 4.0, 2.0, 1.0, 0.5, 0.25 };
+	float modRateHz = 0.5f;
+	bool modSync = false;
+	int modNote = 2;
+	bool modRetrigger = false;
+	bool wasPlaying = false;
+
 	
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AudioPluginAudioProcessor)
 };
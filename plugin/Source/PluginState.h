@@ -0,0 +1,139 @@
+
+/*
+  ==============================================================================
+
+Binary plugin state.
+
+Hosts snapshot the state often (undo, autosave), so it is a small fixed layout
+instead of XML. Everything is little-endian:
+
+  header   uint32 magic ("RVRB"), uint16 version, uint16 header size,
+           uint32 engine seed, uint16 entry count, uint16 entry size
+  entries  uint32 parameter ID hash, float normalised value
+
+Both sizes are stored, so a later build can append header fields or per-entry
+data under the same version, and older builds skip over them. Anything else
+that changes the layout needs a new version: read() only accepts the version it
+knows, so it never parses another layout as this one. Parameters are identified
+by a hash of their ID string (FNV-1a, at compile time): entries with unknown
+hashes are ignored, and parameters missing from the blob keep their current
+value.
+
+Anything read() turns down goes to the old XML state path (see
+setStateInformation), which ignores what it can't parse.
+
+No JUCE in here.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "ParameterEvents.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+
+constexpr uint32_t fnv1a(const char* text) {
+	uint32_t hash = 2166136261u;
+	for (; *text != 0; ++text) {
+		hash = (hash ^ static_cast<uint8_t>(*text))*16777619u;
+	}
+	return hash;
+}
+
+// Indexed by ParamId
+constexpr std::array<uint32_t, numParams> paramIdHashes = [] {
+	std::array<uint32_t, numParams> hashes{};
+	for (int i = 0; i < numParams; ++i) hashes[i] = fnv1a(paramIdStrings[i]);
+	return hashes;
+}();
+
+constexpr bool paramIdHashesUnique() {
+	for (int i = 0; i < numParams; ++i) {
+		for (int j = i + 1; j < numParams; ++j) {
+			if (paramIdHashes[i] == paramIdHashes[j]) return false;
+		}
+	}
+	return true;
+}
+static_assert(paramIdHashesUnique(), "Parameter ID hashes collide, the state can't tell them apart");
+
+
+struct PluginState {
+	static constexpr uint32_t magic = 0x42525652;  // "RVRB" in memory order
+	static constexpr uint16_t version = 1;
+	static constexpr uint16_t headerSize = 16;
+	static constexpr uint16_t entrySize = 8;
+
+	uint32_t seed = 0;
+	std::array<float, numParams> values{};  // normalised 0-1
+	std::array<bool, numParams> found{};    // read() only sets what was in the blob
+
+	static bool isBinary(const void* data, size_t size) {
+		return size >= headerSize && readU32(static_cast<const uint8_t*>(data)) == magic;
+	}
+
+	void write(std::vector<uint8_t>& out) const {
+		out.clear();
+		out.reserve(headerSize + numParams*entrySize);
+		writeU32(out, magic);
+		writeU16(out, version);
+		writeU16(out, headerSize);
+		writeU32(out, seed);
+		writeU16(out, static_cast<uint16_t>(numParams));
+		writeU16(out, entrySize);
+		for (int i = 0; i < numParams; ++i) {
+			uint32_t bits;
+			std::memcpy(&bits, &values[i], sizeof(bits));
+			writeU32(out, paramIdHashes[i]);
+			writeU32(out, bits);
+		}
+	}
+
+	// False if it's not a binary state, is another version, or is cut short
+	bool read(const void* data, size_t size) {
+		if (!isBinary(data, size)) return false;
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		if (readU16(bytes + 4) != version) return false;
+
+		size_t blobHeaderSize = readU16(bytes + 6);
+		size_t count = readU16(bytes + 12), blobEntrySize = readU16(bytes + 14);
+		if (blobHeaderSize < headerSize || blobEntrySize < entrySize) return false;
+		if (blobHeaderSize + count*blobEntrySize > size) return false;
+
+		seed = readU32(bytes + 8);
+		found.fill(false);
+		for (size_t e = 0; e < count; ++e) {
+			const uint8_t* entry = bytes + blobHeaderSize + e*blobEntrySize;
+			uint32_t hash = readU32(entry), bits = readU32(entry + 4);
+			for (int i = 0; i < numParams; ++i) {
+				if (paramIdHashes[i] == hash) {
+					std::memcpy(&values[i], &bits, sizeof(bits));
+					found[i] = true;
+					break;
+				}
+			}
+		}
+		return true;
+	}
+
+private:
+	static void writeU16(std::vector<uint8_t>& out, uint16_t v) {
+		out.push_back(uint8_t(v));
+		out.push_back(uint8_t(v >> 8));
+	}
+	static void writeU32(std::vector<uint8_t>& out, uint32_t v) {
+		writeU16(out, uint16_t(v));
+		writeU16(out, uint16_t(v >> 16));
+	}
+	static uint16_t readU16(const uint8_t* p) {
+		return uint16_t(p[0] | (p[1] << 8));
+	}
+	static uint32_t readU32(const uint8_t* p) {
+		return uint32_t(readU16(p)) | (uint32_t(readU16(p + 2)) << 16);
+	}
+};
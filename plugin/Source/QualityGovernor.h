@@ -0,0 +1,482 @@
+
+/*
+  ==============================================================================
+
+Adaptive quality: steps down to cheaper engine tiers under CPU pressure, and
+back up once there's headroom again.
+
+QualityGovernor decides. It's fed each block's load (processBlock time as a
+fraction of the block's duration, see CpuMeter.h) and smooths it:
+  - step down when the smoothed load stays above 60% for 0.25 s, or at once
+    on a missed deadline
+  - step up when it stays below 25% for 5 s, and the tier above is expected
+    to fit: the current load times the cost ratio between the two tiers, as
+    last measured (twice, if the tier above hasn't run yet)
+
+GovernedReverbEngine holds one engine per tier (EngineTier in ReverbEngine.h)
+and crossfades between them over 100 ms. While fading it runs both, so the
+governor ignores those blocks. configure() only builds the tier it starts on.
+The first time the governor asks for another one, the audio thread can't
+allocate it, so it stays where it is and leaves a request, and maintain()
+builds and configures that tier. The governor asks again on its next
+decision, and by then the tier is there.
+
+A tier that has been faded out still holds its old tail. It's marked stale,
+and maintain() (any thread but the audio thread) reconfigures it so it comes
+back in clean. A stale tier is never switched to, by any path, and the mark
+is only cleared once its configure() has returned.
+
+Pipelined (setPipelineBlockSize), each tier that has been built has its own
+worker thread. Tiers that aren't running leave theirs asleep.
+
+Offline renders (setOffline) use the high tier, which the governor never picks.
+Every tier's wet level is matched to the full one, so switching doesn't shift
+the mix. The trims come from running the same noise burst through a
+temporary engine of each tier, once per layout, tier and sample rate in the
+process, and only when a tier other than full is first built. So loading an
+instance doesn't render anything.
+
+No JUCE in here.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "ReverbEngine.h"
+#include "ReverbAnalysis.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+constexpr int engineTierCount = static_cast<int>(EngineTier::count);
+
+
+class QualityGovernor {
+public:
+	static constexpr int topTier = static_cast<int>(EngineTier::full);  // high is for offline renders
+	static constexpr double smoothingSeconds = 0.1;
+	static constexpr float stepDownLoad = 0.6f;
+	static constexpr double stepDownSeconds = 0.25;
+	static constexpr float stepUpLoad = 0.25f;
+	static constexpr double stepUpSeconds = 5.0;
+	static constexpr float stepUpHeadroom = 0.8f;  // the tier above must be expected below this much of stepDownLoad
+	static constexpr float maxCostRatio = 4.0f;
+
+	// Returns the tier to use from now on (the current one if nothing changes)
+	int update(int tier, float load, double seconds)
+	{
+		measured[tier] = (measured[tier] > 0) ? measured[tier] + (load - measured[tier]) * coefficient(seconds) : load;
+		smoothed += (load - smoothed) * coefficient(seconds);
+
+		highSeconds = (smoothed > stepDownLoad) ? highSeconds + seconds : 0;
+		lowSeconds = (smoothed < stepUpLoad) ? lowSeconds + seconds : 0;
+
+		if (tier + 1 < engineTierCount && (load > 1.0f || highSeconds >= stepDownSeconds))
+			return tier + 1;
+
+		if (tier > topTier && lowSeconds >= stepUpSeconds)
+		{
+			// The two were measured at different times (and the other under pressure), so the ratio is capped
+			float ratio = 2;
+			if (measured[tier - 1] > 0 && measured[tier] > 0)
+				ratio = std::clamp(measured[tier - 1] / measured[tier], 1.0f, maxCostRatio);
+			if (smoothed * ratio < stepUpHeadroom * stepDownLoad)
+				return tier - 1;
+			lowSeconds = 0;  // not yet, look again later
+		}
+		return tier;
+	}
+
+	// After a switch, the load history belongs to the old tier
+	void restart()
+	{
+		smoothed = 0;
+		highSeconds = lowSeconds = 0;
+	}
+
+	void reset()
+	{
+		restart();
+		measured.fill(0);
+	}
+
+private:
+	float smoothed = 0;
+	double highSeconds = 0, lowSeconds = 0;
+	std::array<float, engineTierCount> measured{};  // per tier, 0 = never ran
+
+	static float coefficient(double seconds)
+	{
+		return static_cast<float>(1.0 - std::exp(-seconds / smoothingSeconds));
+	}
+};
+
+
+class GovernedReverbEngine : public ReverbEngine {
+public:
+	// Host bus, see createReverbEngine()
+	struct Layout {
+		int numHostChannels = 2;
+		int lfeChannel = -1;
+		int ambisonicOrder = -1;
+		StereoMode stereoMode = StereoMode::stereo;
+	};
+
+	static constexpr double fadeSeconds = 0.1;
+
+	// Allocates the full tier. The others are built when they're first needed.
+	explicit GovernedReverbEngine(const Layout& layout)
+		: GovernedReverbEngine(layout, createTier(layout, EngineTier::full)) {}
+
+	// Allocates, configures and level-matches the tier it starts on (and any others already built),
+	// so never on the audio thread
+	void configure(double sampleRate) override
+	{
+		REVERB_TRACE_SCOPE("GovernedReverbEngine::configure");
+		configuredSampleRate = sampleRate;
+		const int start = static_cast<int>(offline.load() ? EngineTier::high : EngineTier::full);
+		for (int t : { static_cast<int>(EngineTier::full), start })
+		{
+			if (tiers[t] == nullptr) tiers[t] = createTier(layout, static_cast<EngineTier>(t));
+		}
+
+		unsigned built = 0;
+		for (int t = 0; t < engineTierCount; ++t)
+		{
+			if (tiers[t] == nullptr)
+				continue;
+			levelTrim[t] = matchedLevel(layout, t, sampleRate);
+			prepare(t, true);
+			built |= 1u << t;
+		}
+		builtTiers.store(built, std::memory_order_release);
+		staleTiers.store(0);
+		requestedTiers.store(0);
+
+		fadeLength = std::max(1, static_cast<int>(fadeSeconds * sampleRate));
+		fadeFrom = -1;
+		governor.reset();
+		active.store(start);
+	}
+
+	// setOffline() from any thread: offline renders switch to the high tier (crossfaded, if already
+	// running), and the running tiers wait for their pipeline workers.
+
+	int takePipelineMisses() override
+	{
+		int misses = 0;
+		forRunning([&](ReverbEngine &e, double) { misses += e.takePipelineMisses(); });
+		return misses;
+	}
+
+	// Not on the audio thread: builds the tiers the audio thread has asked for, and clears the tails
+	// of tiers that were faded out. Returns true if it built or reconfigured anything.
+	bool maintain()
+	{
+		if (configuredSampleRate <= 0)
+			return false;
+		const unsigned wanted = requestedTiers.exchange(0, std::memory_order_acquire) & ~builtTiers.load(std::memory_order_acquire);
+		const unsigned pending = wanted | staleTiers.load(std::memory_order_acquire);
+		if (pending == 0)
+			return false;
+
+		for (int t = 0; t < engineTierCount; ++t)
+		{
+			if (!(pending & (1u << t)))
+				continue;
+			if (tiers[t] == nullptr)
+			{
+				tiers[t] = createTier(layout, static_cast<EngineTier>(t));
+				levelTrim[t] = matchedLevel(layout, t, configuredSampleRate);
+			}
+			// The audio thread owns `parameters`: switchTo() applies them
+			prepare(t, false);
+			// Only now can it be switched to
+			builtTiers.fetch_or(1u << t, std::memory_order_release);
+			staleTiers.fetch_and(~(1u << t), std::memory_order_release);
+		}
+		return true;
+	}
+
+	// Audio thread, after each block
+	void reportLoad(float load, double seconds)
+	{
+		if (fadeFrom >= 0 || seconds <= 0 || offline.load(std::memory_order_relaxed))
+			return;  // running two tiers, the load says nothing about either (and offline, nothing counts)
+
+		const int tier = getActiveTier();
+		int next = governor.update(tier, load, seconds);
+		// A tier that isn't built yet or is stale may be being configured. Stepping down skips to a
+		// cheaper one if there is one (and asks for the one it wanted), stepping up waits.
+		if (next > tier && !isUsable(next))
+		{
+			requestTier(next);
+			while (next + 1 < engineTierCount && !isUsable(next))
+				++next;
+		}
+		if (next != tier)
+			switchTo(next);
+	}
+
+	// May be read from any thread
+	EngineTier getTier() const { return static_cast<EngineTier>(getActiveTier()); }
+
+	// Every tier gets the same latency, so switching doesn't change it
+	int getLatencySamples() const override { return tiers[getActiveTier()]->getLatencySamples(); }
+	double getDryScale() const override { return tiers[getActiveTier()]->getDryScale(); }
+
+	const char* getName() const override { return tiers[getActiveTier()]->getName(); }
+	int getNetworkChannels() const override { return tiers[getActiveTier()]->getNetworkChannels(); }
+
+#if REVERB_STAGE_TIMING
+	StageTimer& getStageTimer() override { return tiers[getActiveTier()]->getStageTimer(); }
+#endif
+
+	// Only the tiers that are running get these. A tier picks up the rest when it's switched in.
+	// The wet gains go through the tier's level match.
+	void setRoomSize(double sizeMs) override { parameters.roomSizeMs = sizeMs; forRunning([&](ReverbEngine &e, double) { e.setRoomSize(sizeMs); }); }
+	void setDecay(double rt60) override { parameters.rt60 = rt60; forRunning([&](ReverbEngine &e, double) { e.setDecay(rt60); }); }
+	void setDry(double dry) override { parameters.dry = dry; forRunning([&](ReverbEngine &e, double) { e.setDry(dry); }); }
+	void setDiffusionGain(double gain) override { parameters.diffusionGain = gain; forRunning([&](ReverbEngine &e, double trim) { e.setDiffusionGain(gain * trim); }); }
+	void setEarlyReflections(double gain) override { parameters.earlyReflections = gain; forRunning([&](ReverbEngine &e, double trim) { e.setEarlyReflections(gain * trim); }); }
+	void setPreDelay(double timeMs) override { parameters.preDelayMs = timeMs; forRunning([&](ReverbEngine &e, double) { e.setPreDelay(timeMs); }); }
+	void setModulationDepth(double depthMs) override { parameters.modulationDepthMs = depthMs; forRunning([&](ReverbEngine &e, double) { e.setModulationDepth(depthMs); }); }
+	void setModulationRate(double rateHz) override { parameters.modulationRateHz = rateHz; forRunning([&](ReverbEngine &e, double) { e.setModulationRate(rateHz); }); }
+	void retriggerModulation() override { forRunning([](ReverbEngine &e, double) { e.retriggerModulation(); }); }
+
+	using ReverbEngine::process;
+
+	void process(const BufferView<double>& io, int numSamples) override
+	{
+		const bool isOffline = offline.load(std::memory_order_relaxed);
+		if (fadeFrom < 0)
+		{
+			// In or out of an offline render
+			const int wanted = static_cast<int>(isOffline ? EngineTier::high : EngineTier::full);
+			const int tier = getActiveTier();
+			if ((tier == static_cast<int>(EngineTier::high)) != (wanted == static_cast<int>(EngineTier::high)))
+				switchTo(wanted);
+		}
+		// For the pipelined tiers: whether to wait for a late worker
+		forRunning([&](ReverbEngine &e, double) { e.setOffline(isOffline); });
+
+		auto &current = *tiers[getActiveTier()];
+		if (fadeFrom < 0)
+		{
+			current.process(io, numSamples);
+			return;
+		}
+
+		// Old tier into the scratch copy, new tier in place, then mix a chunk at a time
+		auto &previous = *tiers[fadeFrom];
+		BufferView<double> copy;
+		for (int c = 0; c < numHostChannels; ++c) copy.channels[c] = fadeBuffer[c].data();
+
+		for (int start = 0; start < numSamples; start += fadeChunk)
+		{
+			BufferView<double> chunk = io;
+			for (int c = 0; c < numHostChannels; ++c) chunk.channels[c] += start * io.stride;
+
+			if (fadeFrom < 0)
+			{
+				current.process(chunk, numSamples - start);
+				return;
+			}
+
+			const int length = std::min(fadeChunk, numSamples - start);
+			for (int c = 0; c < numHostChannels; ++c)
+				copyStrided(chunk.channels[c], io.stride, fadeBuffer[c].data(), 1, length);
+
+			previous.process(copy, length);
+			current.process(chunk, length);
+
+			for (int c = 0; c < numHostChannels; ++c)
+			{
+				double* out = chunk.channels[c];
+				const double* old = fadeBuffer[c].data();
+				for (int i = 0; i < length; ++i)
+				{
+					const double gain = std::min(1.0, (fadePosition + i) / static_cast<double>(fadeLength));
+					out[i * io.stride] = old[i] + (out[i * io.stride] - old[i]) * gain;
+				}
+			}
+
+			fadePosition += length;
+			if (fadePosition >= fadeLength)
+			{
+				// Done with the old tier: it keeps its tail until maintain() clears it
+				staleTiers.fetch_or(1u << fadeFrom, std::memory_order_release);
+				fadeFrom = -1;
+			}
+		}
+	}
+
+private:
+	const Layout layout;
+	std::array<std::unique_ptr<ReverbEngine>, engineTierCount> tiers;  // null until built
+	std::atomic<int> active{0};
+	// Bit per tier
+	std::atomic<unsigned> builtTiers{0};      // built and configured
+	std::atomic<unsigned> staleTiers{0};      // faded out, waiting for maintain()
+	std::atomic<unsigned> requestedTiers{0};  // wanted by the audio thread, for maintain() to build
+	QualityGovernor governor;
+	double configuredSampleRate = 0;
+	std::array<double, engineTierCount> levelTrim;  // wet gain, relative to the full tier
+
+	// Crossfade (audio thread). fadeFrom is the tier fading out, -1 when not fading.
+	static constexpr int fadeChunk = 256;
+	int fadeFrom = -1;
+	int fadePosition = 0;
+	int fadeLength = 4800;
+	std::array<std::array<double, fadeChunk>, maxChannels> fadeBuffer;
+
+	// Latest values, for a tier being switched in
+	struct Parameters {
+		double roomSizeMs = 50, rt60 = 6, dry = 0.5, diffusionGain = 0.3, earlyReflections = 0;
+		double preDelayMs = 0, modulationDepthMs = 0, modulationRateHz = 0.5;
+	} parameters;
+
+	int getActiveTier() const { return active.load(std::memory_order_relaxed); }
+
+	template<class Function>
+	void forRunning(Function&& function)
+	{
+		const int tier = getActiveTier();
+		function(*tiers[tier], levelTrim[tier]);
+		if (fadeFrom >= 0) function(*tiers[fadeFrom], levelTrim[fadeFrom]);
+	}
+
+	void applyParameters(int tier)
+	{
+		auto &engine = *tiers[tier];
+		engine.setRoomSize(parameters.roomSizeMs);
+		engine.setDecay(parameters.rt60);
+		engine.setDry(parameters.dry);
+		engine.setDiffusionGain(parameters.diffusionGain * levelTrim[tier]);
+		engine.setEarlyReflections(parameters.earlyReflections * levelTrim[tier]);
+		engine.setPreDelay(parameters.preDelayMs);
+		engine.setModulationDepth(parameters.modulationDepthMs);
+		engine.setModulationRate(parameters.modulationRateHz);
+	}
+
+	GovernedReverbEngine(const Layout& layout, std::unique_ptr<ReverbEngine> fullTier)
+		: ReverbEngine(fullTier->getNumChannels()), layout(layout)
+	{
+		tiers[static_cast<int>(EngineTier::full)] = std::move(fullTier);
+		levelTrim.fill(1.0);
+	}
+
+	static std::unique_ptr<ReverbEngine> createTier(const Layout& layout, EngineTier tier)
+	{
+		return createReverbEngine(layout.numHostChannels, layout.lfeChannel, layout.ambisonicOrder, layout.stereoMode, tier);
+	}
+
+	// Built, and not stale: maintain() isn't touching it
+	bool isUsable(int tier) const
+	{
+		return (builtTiers.load(std::memory_order_acquire) & ~staleTiers.load(std::memory_order_acquire)) & (1u << tier);
+	}
+
+	// Audio thread: for maintain() to build
+	void requestTier(int tier) { requestedTiers.fetch_or(1u << tier, std::memory_order_release); }
+
+	// Audio thread: starts the crossfade. A tier that isn't usable yet is asked for instead,
+	// and the caller tries again later.
+	void switchTo(int tier)
+	{
+		if (!isUsable(tier))
+		{
+			requestTier(tier);
+			return;
+		}
+		applyParameters(tier);
+		fadeFrom = getActiveTier();
+		fadePosition = 0;
+		active.store(tier, std::memory_order_relaxed);
+		governor.restart();
+		REVERB_TRACE_VALUE("quality tier", tier);
+	}
+
+	// Not on the audio thread: seeds and configures a built tier. The latest parameters can only be
+	// applied here while the audio thread isn't running (from configure()).
+	void prepare(int tier, bool withParameters)
+	{
+		auto &engine = *tiers[tier];
+		engine.setSeed(this->seed);
+		if (withParameters)
+			applyParameters(tier);
+		engine.setPipelineBlockSize(this->pipelineBlockSize);
+		engine.configure(configuredSampleRate);
+	}
+
+	// Wet gain that brings a tier to the full tier's level
+	static double matchedLevel(const Layout& layout, int tier, double sampleRate)
+	{
+		if (tier == static_cast<int>(EngineTier::full))
+			return 1.0;
+		const double reference = calibratedEnergy(layout, static_cast<int>(EngineTier::full), sampleRate);
+		const double energy = calibratedEnergy(layout, tier, sampleRate);
+		return (energy > 0 && reference > 0) ? std::clamp(std::sqrt(reference / energy), 0.5, 2.0) : 1.0;
+	}
+
+	// Wet energy of a tier from a noise burst, with no dry. Measured on a temporary engine with a fixed
+	// seed, once per layout, tier and sample rate in the process, so further instances get it for free.
+	static double calibratedEnergy(const Layout& layout, int tier, double sampleRate)
+	{
+		struct Measured {
+			Layout layout;
+			int tier;
+			double sampleRate;
+			double energy;
+		};
+		static std::mutex mutex;
+		static std::vector<Measured> measured;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		for (const auto &entry : measured)
+		{
+			if (entry.layout.numHostChannels == layout.numHostChannels && entry.layout.lfeChannel == layout.lfeChannel
+				&& entry.layout.ambisonicOrder == layout.ambisonicOrder && entry.layout.stereoMode == layout.stereoMode
+				&& entry.tier == tier && entry.sampleRate == sampleRate)
+				return entry.energy;
+		}
+
+		constexpr uint32_t calibrationSeed = 1;
+		auto engine = createTier(layout, static_cast<EngineTier>(tier));
+		engine->setSeed(calibrationSeed);
+		const auto burst = noiseBurstStimulus(static_cast<int>(0.25 * sampleRate), static_cast<int>(0.025 * sampleRate), calibrationSeed);
+		engine->setDry(0);
+		engine->setDiffusionGain(0.3);
+		engine->setEarlyReflections(0);
+		engine->setRoomSize(50);
+		engine->setDecay(2);
+		engine->setPreDelay(0);
+		engine->setModulationDepth(0);
+		double energy = 0;
+		for (const auto &channel : renderStimulus(*engine, sampleRate, burst))
+			for (double x : channel) energy += x * x;
+
+		measured.push_back({ layout, tier, sampleRate, energy });
+		return energy;
+	}
+};
+
+
+// The engine for the host layout, see createReverbEngine()
+inline std::unique_ptr<GovernedReverbEngine> createGovernedReverbEngine(int numHostChannels, int lfeChannel, int ambisonicOrder = -1,
+                                                                        StereoMode stereoMode = StereoMode::stereo)
+{
+	GovernedReverbEngine::Layout layout;
+	layout.numHostChannels = numHostChannels;
+	layout.lfeChannel = lfeChannel;
+	layout.ambisonicOrder = ambisonicOrder;
+	layout.stereoMode = stereoMode;
+	return std::make_unique<GovernedReverbEngine>(layout);
+}
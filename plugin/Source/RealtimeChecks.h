@@ -0,0 +1,183 @@
+
+/*
+  ==============================================================================
+
+Real-time safety checks (opt-in, compile-time).
+
+Build with -DREVERB_RT_CHECKS=ON (CMake) to turn them on. Otherwise the macros
+are empty and none of this is compiled in.
+
+The audio callback runs inside REVERB_RT_SCOPE(). While a thread is inside one,
+any of these counts as a violation:
+  - operator new/delete (replaced in the one translation unit that defines
+    REVERB_RT_CHECKS_IMPLEMENTATION)
+  - pthread_mutex_lock, on Linux (interposed in the same place)
+  - our own system calls: LazyZeroArray allocating or freeing pages
+
+A violation is counted, and by default reported on stderr and aborted on, so a
+run under automation stops at the first one (with a usable stack in a
+debugger). Set RealtimeChecks::abortOnViolation to false to just count.
+
+The replacements take effect where the binary's own symbols win: executables
+linking reverb_core, and the standalone plugin. A plugin loaded by a host will
+usually still bind to the host's allocator, but the LazyZeroArray checks work
+everywhere.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#ifndef REVERB_RT_CHECKS
+	#define REVERB_RT_CHECKS 0
+#endif
+
+#if REVERB_RT_CHECKS
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+
+struct RealtimeChecks {
+	static inline std::atomic<bool> abortOnViolation{true};
+
+	// Count and first violation (for a summary at the end of a run)
+	static inline std::atomic<uint32_t> violations{0};
+	static inline std::atomic<const char*> firstViolation{nullptr};
+
+	static bool inRealtimeScope() {
+		return depth() > 0 && !reporting();
+	}
+
+	// `what` must be a string literal
+	static void check(const char* what) {
+		if (!inRealtimeScope()) return;
+		reporting() = true;  // the report itself mustn't count
+
+		violations.fetch_add(1, std::memory_order_relaxed);
+		const char* expected = nullptr;
+		firstViolation.compare_exchange_strong(expected, what);
+		if (abortOnViolation.load(std::memory_order_relaxed)) {
+			std::fputs("Real-time violation in the audio callback: ", stderr);
+			std::fputs(what, stderr);
+			std::fputs("\n", stderr);
+			std::abort();
+		}
+		reporting() = false;
+	}
+
+	struct Scope {
+		Scope() {
+			++depth();
+		}
+		~Scope() {
+			--depth();
+		}
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+	};
+
+private:
+	static int& depth() {
+		thread_local int value = 0;
+		return value;
+	}
+	static bool& reporting() {
+		thread_local bool value = false;
+		return value;
+	}
+};
+
+#define REVERB_RT_JOIN2(a, b) a##b
+#define REVERB_RT_JOIN(a, b) REVERB_RT_JOIN2(a, b)
+#define REVERB_RT_SCOPE() RealtimeChecks::Scope REVERB_RT_JOIN(realtimeScope, __LINE__)
+#define REVERB_RT_CHECK(what) RealtimeChecks::check(what)
+
+
+#ifdef REVERB_RT_CHECKS_IMPLEMENTATION
+
+#include <new>
+
+#if defined(__linux__)
+	#include <dlfcn.h>
+	#include <pthread.h>
+#endif
+
+void* operator new(std::size_t size) {
+	RealtimeChecks::check("operator new");
+	if (void* p = std::malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) {
+	RealtimeChecks::check("operator new[]");
+	if (void* p = std::malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+void* operator new(std::size_t size, std::align_val_t align) {
+	RealtimeChecks::check("operator new");
+	std::size_t alignment = std::max(static_cast<std::size_t>(align), sizeof(void*));
+	void* p = nullptr;
+#if defined(_WIN32)
+	p = _aligned_malloc(size ? size : 1, alignment);
+#else
+	if (posix_memalign(&p, alignment, size ? size : 1) != 0) p = nullptr;
+#endif
+	if (p == nullptr) throw std::bad_alloc();
+	return p;
+}
+void* operator new[](std::size_t size, std::align_val_t align) {
+	return operator new(size, align);
+}
+
+void operator delete(void* p) noexcept {
+	if (p != nullptr) RealtimeChecks::check("operator delete");
+	std::free(p);
+}
+void operator delete[](void* p) noexcept {
+	if (p != nullptr) RealtimeChecks::check("operator delete[]");
+	std::free(p);
+}
+void operator delete(void* p, std::size_t) noexcept {
+	operator delete(p);
+}
+void operator delete[](void* p, std::size_t) noexcept {
+	operator delete[](p);
+}
+void operator delete(void* p, std::align_val_t) noexcept {
+	if (p != nullptr) RealtimeChecks::check("operator delete");
+#if defined(_WIN32)
+	_aligned_free(p);
+#else
+	std::free(p);
+#endif
+}
+void operator delete[](void* p, std::align_val_t align) noexcept {
+	operator delete(p, align);
+}
+void operator delete(void* p, std::size_t, std::align_val_t align) noexcept {
+	operator delete(p, align);
+}
+void operator delete[](void* p, std::size_t, std::align_val_t align) noexcept {
+	operator delete(p, align);
+}
+
+#if defined(__linux__)
+extern "C" int pthread_mutex_lock(pthread_mutex_t* mutex) {
+	using Lock = int (*)(pthread_mutex_t*);
+	static Lock next = reinterpret_cast<Lock>(dlsym(RTLD_NEXT, "pthread_mutex_lock"));
+	RealtimeChecks::check("pthread_mutex_lock");
+	return next(mutex);
+}
+#endif
+
+#endif // REVERB_RT_CHECKS_IMPLEMENTATION
+
+#else
+
+#define REVERB_RT_SCOPE() do {} while (false)
+#define REVERB_RT_CHECK(what) do {} while (false)
+
+#endif
@@ -0,0 +1,215 @@
+
+/*
+  ==============================================================================
+
+Offline analysis for checking that an optimisation doesn't change the sound.
+
+  - Stimuli: impulse, seeded noise burst, exponential sine sweep
+  - Rendering a stimulus through an engine with a fixed seed
+  - Energy decay curve (Schroeder) and RT60 from it
+  - Comparing an output against a reference: bit-exact, or the error energy
+    in dB relative to the reference
+  - A small golden-file format for storing reference outputs
+
+Engines are deterministic for a given seed, parameters, input and block
+sizes, so identical code paths should match bit-exactly. Float versus double
+I/O, or a vectorised kernel versus a scalar one, should stay well below
+-100 dB (float I/O alone is around -140 dB).
+
+No JUCE in here.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "ReverbEngine.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+
+// Channels of samples, [channel][sample]
+using Signal = std::vector<std::vector<double>>;
+
+
+// ---- Stimuli (mono, copied to every input channel when rendering)
+
+inline std::vector<double> impulseStimulus(int length) {
+	std::vector<double> signal(size_t(std::max(length, 1)), 0.0);
+	signal[0] = 1;
+	return signal;
+}
+
+// White noise for burstLength samples, then silence
+inline std::vector<double> noiseBurstStimulus(int length, int burstLength, uint32_t seed, double gain = 0.5) {
+	std::vector<double> signal(size_t(std::max(length, 1)), 0.0);
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<double> dist(-gain, gain);
+	for (int i = 0; i < std::min(length, burstLength); ++i) signal[size_t(i)] = dist(rng);
+	return signal;
+}
+
+// Exponential sweep from lowHz to highHz over sweepLength samples (with short fades), then silence
+inline std::vector<double> sineSweepStimulus(int length, int sweepLength, double sampleRate,
+                                             double lowHz = 20, double highHz = 20000, double gain = 0.5) {
+	std::vector<double> signal(size_t(std::max(length, 1)), 0.0);
+	sweepLength = std::min(length, sweepLength);
+	highHz = std::min(highHz, 0.45*sampleRate);
+	double seconds = sweepLength/sampleRate;
+	double k = std::log(highHz/lowHz);
+	int fade = std::max(1, std::min(sweepLength/10, int(0.01*sampleRate)));
+	for (int i = 0; i < sweepLength; ++i) {
+		double t = i/sampleRate;
+		double phase = 2*M_PI*lowHz*seconds/k*(std::exp(t/seconds*k) - 1);
+		double window = 1;
+		if (i < fade) window = 0.5 - 0.5*std::cos(M_PI*i/fade);
+		if (i >= sweepLength - fade) window = 0.5 - 0.5*std::cos(M_PI*(sweepLength - 1 - i)/fade);
+		signal[size_t(i)] = gain*window*std::sin(phase);
+	}
+	return signal;
+}
+
+
+// ---- Rendering
+
+// Runs the stimulus through the engine in blocks, with the same signal on every input channel.
+// Seed and parameters are the caller's: set them before calling (configure() is called here).
+template<typename Sample = double>
+Signal renderStimulus(ReverbEngine& engine, double sampleRate, const std::vector<double>& stimulus, int blockSize = 256) {
+	engine.configure(sampleRate);
+	engine.setOffline(true);  // a pipelined engine waits for its worker, so the output is exact
+
+	const int channels = engine.getNumChannels();
+	const int length = int(stimulus.size());
+	std::vector<std::vector<Sample>> buffer(static_cast<size_t>(channels), std::vector<Sample>(static_cast<size_t>(length)));
+	for (auto &channel : buffer) {
+		for (int i = 0; i < length; ++i) channel[size_t(i)] = static_cast<Sample>(stimulus[size_t(i)]);
+	}
+
+	std::vector<Sample*> pointers(static_cast<size_t>(channels));
+	for (int start = 0; start < length; start += blockSize) {
+		for (int c = 0; c < channels; ++c) pointers[size_t(c)] = buffer[size_t(c)].data() + start;
+		engine.process(pointers.data(), std::min(blockSize, length - start));
+	}
+
+	Signal output(static_cast<size_t>(channels));
+	for (int c = 0; c < channels; ++c) output[size_t(c)].assign(buffer[size_t(c)].begin(), buffer[size_t(c)].end());
+	return output;
+}
+
+
+// ---- Decay
+
+// Schroeder backward integration, in dB relative to the total energy (starts at 0 dB).
+// Channels are summed in energy.
+inline std::vector<double> energyDecayCurve(const Signal& signal) {
+	size_t length = signal.empty() ? 0 : signal[0].size();
+	std::vector<double> curve(length, 0.0);
+	double sum = 0;
+	for (size_t i = length; i-- > 0;) {
+		for (const auto &channel : signal) sum += channel[i]*channel[i];
+		curve[i] = sum;
+	}
+	double total = (length > 0) ? curve[0] : 0;
+	for (auto &value : curve) value = (total > 0 && value > 0) ? 10*std::log10(value/total) : -300;
+	return curve;
+}
+
+// Least-squares slope of the curve between fromDb and toDb, extrapolated to 60 dB (T30 by default,
+// use -5/-25 for T20). Returns 0 if the curve doesn't get down to toDb.
+inline double rt60FromDecay(const std::vector<double>& curveDb, double sampleRate, double fromDb = -5, double toDb = -35) {
+	double n = 0, sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+	bool reached = false;
+	for (size_t i = 0; i < curveDb.size(); ++i) {
+		double y = curveDb[i];
+		if (y > fromDb) continue;
+		if (y < toDb) {
+			reached = true;
+			break;
+		}
+		double x = i/sampleRate;
+		n += 1;
+		sumX += x;
+		sumY += y;
+		sumXX += x*x;
+		sumXY += x*y;
+	}
+	if (!reached || n < 2) return 0;
+	double slope = (n*sumXY - sumX*sumY)/(n*sumXX - sumX*sumX);  // dB per second
+	return (slope < 0) ? -60/slope : 0;
+}
+
+
+// ---- Comparison
+
+struct OutputDifference {
+	bool identical = true;      // bit for bit
+	double maxAbs = 0;          // largest sample difference
+	double errorDb = -300;      // error energy relative to the reference energy
+};
+
+inline OutputDifference compareOutputs(const Signal& reference, const Signal& test) {
+	OutputDifference result;
+	if (reference.size() != test.size()) {
+		result.identical = false;
+		result.errorDb = 300;
+		return result;
+	}
+	double referenceEnergy = 0, errorEnergy = 0;
+	for (size_t c = 0; c < reference.size(); ++c) {
+		if (reference[c].size() != test[c].size()) {
+			result.identical = false;
+			result.errorDb = 300;
+			return result;
+		}
+		for (size_t i = 0; i < reference[c].size(); ++i) {
+			double r = reference[c][i], t = test[c][i];
+			// Bitwise, so a changed sign of zero or a NaN counts
+			if (std::memcmp(&r, &t, sizeof(double)) != 0) result.identical = false;
+			double diff = t - r;
+			result.maxAbs = std::max(result.maxAbs, std::abs(diff));
+			referenceEnergy += r*r;
+			errorEnergy += diff*diff;
+		}
+	}
+	if (errorEnergy > 0) result.errorDb = (referenceEnergy > 0) ? 10*std::log10(errorEnergy/referenceEnergy) : 300;
+	return result;
+}
+
+
+// ---- Golden files: "RVGD", uint32 version, uint32 channels, uint32 length, then the doubles
+// channel by channel. Native byte order (they're for one build machine's regression runs).
+
+inline bool writeGoldenFile(const std::string& path, const Signal& signal) {
+	std::FILE* file = std::fopen(path.c_str(), "wb");
+	if (file == nullptr) return false;
+	uint32_t header[4] = {0x44475652, 1, uint32_t(signal.size()), uint32_t(signal.empty() ? 0 : signal[0].size())};
+	bool ok = std::fwrite(header, sizeof(header), 1, file) == 1;
+	for (const auto &channel : signal) {
+		ok = ok && channel.size() == header[3]
+			&& std::fwrite(channel.data(), sizeof(double), channel.size(), file) == channel.size();
+	}
+	return std::fclose(file) == 0 && ok;
+}
+
+inline bool readGoldenFile(const std::string& path, Signal& signal) {
+	std::FILE* file = std::fopen(path.c_str(), "rb");
+	if (file == nullptr) return false;
+	uint32_t header[4];
+	bool ok = std::fread(header, sizeof(header), 1, file) == 1 && header[0] == 0x44475652 && header[1] == 1;
+	if (ok) {
+		signal.assign(header[2], std::vector<double>(header[3]));
+		for (auto &channel : signal) {
+			ok = ok && std::fread(channel.data(), sizeof(double), channel.size(), file) == channel.size();
+		}
+	}
+	std::fclose(file);
+	return ok;
+}
@@ -0,0 +1,819 @@
+
+/*
+  ==============================================================================
+
+Reverb engines: the FDN network plus the mapping between host channels and
+network channels.
+
+The processor only talks to ReverbEngine. Which network size and mapping is
+behind it depends on the host bus layout:
+  - mono/stereo: 8-channel network, StereoMultiMixer up/downmix
+  - stereo, binaural mode: 16-channel network, rendered through HRIRs
+  - stereo, true stereo mode: two interleaved 8-channel networks, one per input
+  - quad, 5.1, 7.1: 8-channel network mapped directly onto the host channels
+  - 7.1.4: 16-channel network mapped directly onto the host channels
+  - Ambisonics (1st-3rd order): 16-channel network, each channel encoded
+    as a source at its own direction
+
+No JUCE in here.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "FDN_Reverb.h"
+#include "NetworkPipeline.h"
+#include "Ambisonics.h"
+#include "BinauralRenderer.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+
+// Output rendering for stereo buses. Order matches the STEREO_MODE parameter.
+enum class StereoMode : int {
+	stereo = 0,
+	binaural,
+	trueStereo
+};
+
+
+class ReverbEngine {
+public:
+	static constexpr int maxChannels = 16;
+
+	explicit ReverbEngine(int numHostChannels)
+		: numHostChannels(std::min(numHostChannels, maxChannels)), seed(std::random_device{}()) {}
+	virtual ~ReverbEngine() = default;
+
+	int getNumChannels() const { return numHostChannels; }
+
+	// The random delay times and reflection taps come from this seed. Saved with the plugin state,
+	// so a session reloads with the same room. Takes effect at the next configure().
+	void setSeed(uint32_t newSeed) { seed = newSeed; }
+	uint32_t getSeed() const { return seed; }
+
+	virtual void configure(double sampleRate) = 0;
+
+	// Pipelined processing (NetworkPipeline.h): the late half of the network runs on a worker
+	// thread, a block behind. maxBlockSize is the largest call expected, and the latency; 0 is off.
+	// Takes effect at the next configure().
+	virtual void setPipelineBlockSize(int maxBlockSize) { pipelineBlockSize = std::max(0, maxBlockSize); }
+
+	// Offline renders wait for a late pipeline worker. In real time the call goes out dry instead,
+	// and counts as a pipeline miss. Any thread.
+	virtual void setOffline(bool isOffline) { offline.store(isOffline, std::memory_order_relaxed); }
+
+	// Audio thread: calls the pipeline worker was late for, since the last time this was asked
+	virtual int takePipelineMisses() { return std::exchange(pipelineMisses, 0); }
+
+	// For the host's delay compensation. Dry and wet are both delayed by this much.
+	virtual int getLatencySamples() const { return (pipelineControl != nullptr) ? pipelineControl->getLatency() : 0; }
+
+	// Gain from host input to host output per unit of setDry(), for adding the dry signal outside
+	virtual double getDryScale() const { return 1; }
+
+	// For display: the channel mapping, and the size of the network(s) behind it
+	virtual const char* getName() const = 0;
+	virtual int getNetworkChannels() const = 0;
+
+#if REVERB_STAGE_TIMING
+	// The audio thread produces the records, one other thread may drain them (StageTiming.h)
+	virtual StageTimer& getStageTimer() { return stageTimer; }
+#endif
+
+	virtual void setRoomSize(double sizeMs) = 0;
+	virtual void setDecay(double rt60) = 0;
+	virtual void setDry(double dry) = 0;
+	virtual void setDiffusionGain(double gain) = 0;
+	virtual void setEarlyReflections(double gain) = 0;
+	virtual void setPreDelay(double timeMs) = 0;
+	virtual void setModulationDepth(double depthMs) = 0;
+	virtual void setModulationRate(double rateHz) = 0;
+	virtual void retriggerModulation() = 0;
+
+	// Host audio, processed in place: one pointer per channel, with consecutive samples `stride`
+	// apart. Planar buffers have stride 1. An interleaved buffer of N channels has stride N,
+	// with channel c starting at data + c.
+	template<typename Sample>
+	struct BufferView {
+		std::array<Sample*, maxChannels> channels{};
+		int stride = 1;
+
+		static BufferView planar(Sample* const* pointers, int numChannels)
+		{
+			BufferView view;
+			for (int c = 0; c < numChannels && c < maxChannels; ++c) view.channels[c] = pointers[c];
+			return view;
+		}
+
+		static BufferView interleaved(Sample* data, int numChannels)
+		{
+			BufferView view;
+			for (int c = 0; c < numChannels && c < maxChannels; ++c) view.channels[c] = data + c;
+			view.stride = numChannels;
+			return view;
+		}
+	};
+
+	// The network runs in double, so a double host buffer goes straight through, at any stride
+	virtual void process(const BufferView<double>& io, int numSamples) = 0;
+
+	// Float hosts: converted a chunk at a time through a preallocated (planar) double buffer.
+	// The conversion reads and writes the host stride directly, so there is no separate deinterleave pass.
+	void process(const BufferView<float>& io, int numSamples)
+	{
+		const int numChannels = numHostChannels;
+		BufferView<double> converted;
+		for (int c = 0; c < numChannels; ++c) converted.channels[c] = scratch[c].data();
+
+		for (int start = 0; start < numSamples; start += scratchLength)
+		{
+			const int length = std::min(scratchLength, numSamples - start);
+			for (int c = 0; c < numChannels; ++c)
+				copyStrided(io.channels[c] + start * io.stride, io.stride, scratch[c].data(), 1, length);
+
+			process(converted, length);
+
+			for (int c = 0; c < numChannels; ++c)
+				copyStrided(scratch[c].data(), 1, io.channels[c] + start * io.stride, io.stride, length);
+		}
+	}
+
+	// Planar buffers, one pointer per host channel
+	template<typename Sample>
+	void process(Sample* const* channels, int numSamples)
+	{
+		process(BufferView<Sample>::planar(channels, numHostChannels), numSamples);
+	}
+
+	// One interleaved buffer, numSamples frames of getNumChannels() samples
+	template<typename Sample>
+	void processInterleaved(Sample* data, int numSamples)
+	{
+		process(BufferView<Sample>::interleaved(data, numHostChannels), numSamples);
+	}
+
+protected:
+	const int numHostChannels;
+	uint32_t seed;
+	std::atomic<bool> offline{false};
+#if REVERB_STAGE_TIMING
+	StageTimer stageTimer;
+#endif
+
+	// Pipelined: the network's dry level is 0 and the dry signal is added here, delayed to line up
+	// with the wet signal
+	int pipelineBlockSize = 0;
+	PipelineControl* pipelineControl = nullptr;
+	int pipelineMisses = 0;
+	std::array<std::vector<double>, maxChannels> dryDelay;
+	uint32_t dryMask = 0;
+	uint32_t dryPosition = 0;
+
+	// Allocates the dry delay (nullptr: not pipelined)
+	void setPipeline(PipelineControl* control)
+	{
+		pipelineControl = control;
+		const int latency = (control != nullptr) ? control->getLatency() : 0;
+		size_t size = 1;
+		while (size < 2 * size_t(latency)) size *= 2;
+		for (int c = 0; c < numHostChannels; ++c) dryDelay[c].assign((control != nullptr) ? size : 0, 0.0);
+		dryMask = uint32_t(size - 1);
+		dryPosition = 0;
+	}
+
+	// Dry gain from host input to host output, for the delayed dry signal
+	virtual double getDryGain() const { return 0; }
+
+	// What the engines index as host[channel][sample]. The stride is a compile-time constant
+	// for the common cases (planar = 1, interleaved stereo = 2), and read at runtime otherwise (0).
+	template<int fixedStride>
+	struct StridedChannels {
+		const BufferView<double>& io;
+
+		struct Channel {
+			double* data;
+			int stride;
+			double& operator[](int i) const { return data[i * (fixedStride ? fixedStride : stride)]; }
+		};
+
+		Channel operator[](int c) const { return { io.channels[c], io.stride }; }
+	};
+
+	// Below this, input and tail count as silence (-160 dB)
+	static constexpr double silenceThreshold = 1e-8;
+
+	// Set once the input is silent and the tail has died away. While it's set, silent blocks skip
+	// the network entirely (the output is the silent input), so an idle instance never touches
+	// its delay memory. Starts set, so nothing is touched before the first sound.
+	bool idle = true;
+	// The output has to stay silent for longer than the longest path through the network
+	// (pre-delay, early reflections, diffuser, one trip round the feedback loop), otherwise a
+	// quiet gap (e.g. the pre-delay) would cut off the tail still inside it.
+	static constexpr double idleAfterSeconds = 1.0;
+	int idleAfterSamples = 48000;
+	int silentSamples = 0;
+
+	void resetIdle(double sampleRate)
+	{
+		idle = true;
+		silentSamples = 0;
+		idleAfterSamples = static_cast<int>(idleAfterSeconds * sampleRate);
+	}
+
+	double peak(const BufferView<double>& io, int numSamples) const
+	{
+		double peak = 0;
+		for (int c = 0; c < numHostChannels; ++c)
+		{
+			const double* samples = io.channels[c];
+			for (int i = 0; i < numSamples; ++i) peak = std::max(peak, std::abs(samples[i * io.stride]));
+		}
+		return peak;
+	}
+
+	// Calls engine.processChannels() with the loops specialised for the buffer's stride.
+	// Pipelined, in calls no longer than the latency, with the delayed dry added afterwards.
+	template<class Engine>
+	void dispatchStride(Engine& engine, const BufferView<double>& io, int numSamples)
+	{
+		if (pipelineControl == nullptr)
+		{
+			dispatchBlock(engine, io, numSamples);
+			return;
+		}
+
+		const int latency = pipelineControl->getLatency();
+		const double dryGain = getDryGain();
+		for (int start = 0; start < numSamples; start += latency)
+		{
+			const int length = std::min(latency, numSamples - start);
+			BufferView<double> piece = io;
+			for (int c = 0; c < numHostChannels; ++c)
+			{
+				piece.channels[c] += start * io.stride;
+				for (int i = 0; i < length; ++i)
+					dryDelay[c][(dryPosition + uint32_t(i)) & dryMask] = piece.channels[c][i * io.stride];
+			}
+
+			dispatchBlock(engine, piece, length);
+
+			const uint32_t delayed = dryPosition - uint32_t(latency);
+			for (int c = 0; c < numHostChannels; ++c)
+			{
+				for (int i = 0; i < length; ++i)
+					piece.channels[c][i * io.stride] += dryGain * dryDelay[c][(delayed + uint32_t(i)) & dryMask];
+			}
+			dryPosition += uint32_t(length);
+		}
+	}
+
+	template<class Engine>
+	void dispatchBlock(Engine& engine, const BufferView<double>& io, int numSamples)
+	{
+		const bool silentInput = peak(io, numSamples) < silenceThreshold;
+		if (silentInput && idle)
+			return;
+		if (idle)
+			REVERB_TRACE_INSTANT("silence bypass off");
+
+#if REVERB_STAGE_TIMING
+		stageTimer.beginBlock();
+#endif
+		if (pipelineControl != nullptr && !pipelineControl->beginBlock(numSamples, offline.load(std::memory_order_relaxed)))
+			++pipelineMisses;
+		if (io.stride == 1)
+			engine.processChannels(StridedChannels<1>{ io }, numSamples);
+		else if (io.stride == 2)
+			engine.processChannels(StridedChannels<2>{ io }, numSamples);
+		else
+			engine.processChannels(StridedChannels<0>{ io }, numSamples);
+		if (pipelineControl != nullptr)
+			pipelineControl->endBlock();
+#if REVERB_STAGE_TIMING
+		stageTimer.endBlock(numSamples);
+#endif
+
+		// With silent input, the output is all tail
+		if (silentInput && peak(io, numSamples) < silenceThreshold)
+			silentSamples = std::min(silentSamples + numSamples, idleAfterSamples);
+		else
+			silentSamples = 0;
+		idle = silentSamples >= idleAfterSamples;
+		if (idle)
+			REVERB_TRACE_INSTANT("silence bypass on");
+	}
+
+	template<typename From, typename To>
+	static void copyStrided(const From* from, int fromStride, To* to, int toStride, int length)
+	{
+		if (fromStride == 1 && toStride == 1)
+			for (int i = 0; i < length; ++i) to[i] = static_cast<To>(from[i]);
+		else if (fromStride == 2 && toStride == 1)
+			for (int i = 0; i < length; ++i) to[i] = static_cast<To>(from[2 * i]);
+		else if (fromStride == 1 && toStride == 2)
+			for (int i = 0; i < length; ++i) to[2 * i] = static_cast<To>(from[i]);
+		else
+			for (int i = 0; i < length; ++i) to[i * toStride] = static_cast<To>(from[i * fromStride]);
+	}
+
+private:
+	static constexpr int scratchLength = 256;
+	std::array<std::array<double, scratchLength>, maxChannels> scratch;
+};
+
+
+// Forwards the parameters to a BasicReverb. Subclasses do the channel mapping.
+template<int channels, int diffusionSteps, int networks = 1>
+class BasicReverbEngine : public ReverbEngine {
+protected:
+	BasicReverb<channels, diffusionSteps, networks> reverb;
+	std::unique_ptr<NetworkPipeline<channels, diffusionSteps, networks>> pipeline;
+	double dryLevel = 0.5;  // the network's own dry is 0 while pipelined
+
+	double getDryGain() const override { return dryLevel * this->getDryScale(); }
+
+	// The worker's network follows the settings of the late half
+	void updatePipeline()
+	{
+		if (pipeline != nullptr) pipeline->updateSettings(reverb);
+	}
+
+public:
+	explicit BasicReverbEngine(int numHostChannels) : ReverbEngine(numHostChannels)
+	{
+#if REVERB_STAGE_TIMING
+		reverb.timer = &this->stageTimer;
+#endif
+	}
+
+	void configure(double sampleRate) override
+	{
+		REVERB_TRACE_SCOPE("configure");
+		reverb.pipeline = nullptr;
+		pipeline.reset();
+
+		randomInRange::seed(this->seed);
+		reverb.configure(sampleRate);
+		this->resetIdle(sampleRate);
+
+		if (this->pipelineBlockSize > 0)
+			pipeline = std::make_unique<NetworkPipeline<channels, diffusionSteps, networks>>(this->pipelineBlockSize, reverb, sampleRate, this->seed);
+		reverb.pipeline = pipeline.get();
+		reverb.setDry((pipeline != nullptr) ? 0.0 : dryLevel);
+		this->setPipeline(pipeline.get());
+	}
+
+	int getNetworkChannels() const override { return channels * networks; }
+
+	// Before configure()
+	void setEarlyReflectionsEnabled(bool enabled) { reverb.earlyReflectionsEnabled = enabled; }
+
+	void setRoomSize(double sizeMs) override { reverb.setRoomSize(sizeMs); updatePipeline(); }
+	void setDecay(double rt60) override { reverb.setDecay(rt60); updatePipeline(); }
+	void setDry(double dry) override { dryLevel = dry; reverb.setDry((pipeline != nullptr) ? 0.0 : dry); }
+	void setDiffusionGain(double gain) override { reverb.setDiffusionGain(gain); }
+	void setEarlyReflections(double gain) override { reverb.setEarlyReflections(gain); }
+	void setPreDelay(double timeMs) override { reverb.setPreDelay(timeMs); }
+	void setModulationDepth(double depthMs) override { reverb.setModulationDepth(depthMs); updatePipeline(); }
+	void setModulationRate(double rateHz) override { reverb.setModulationRate(rateHz); updatePipeline(); }
+
+	void retriggerModulation() override
+	{
+		reverb.retriggerModulation();
+		if (pipeline != nullptr) pipeline->retriggerModulation();
+	}
+};
+
+
+// Mono or stereo host buses, through the StereoMultiMixer
+template<int channels = 8, int diffusionSteps = 4>
+class StereoReverbEngine : public BasicReverbEngine<channels, diffusionSteps> {
+	using Array = std::array<double, channels>;
+
+public:
+	explicit StereoReverbEngine(int numHostChannels)
+		: BasicReverbEngine<channels, diffusionSteps>(numHostChannels) {}
+
+	const char* getName() const override { return "Stereo"; }
+
+	// Through the up/downmix, as in processChannels
+	double getDryScale() const override
+	{
+		return this->reverb.mixedDryGain * (channels / 2) * this->reverb.scalingFactor;
+	}
+
+	void process(const ReverbEngine::BufferView<double>& io, int numSamples) override
+	{
+		ReverbEngine::dispatchStride(*this, io, numSamples);
+	}
+
+	template<class Channels>
+	void processChannels(const Channels& host, int numSamples)
+	{
+		auto &reverb = this->reverb;
+
+		if (this->numHostChannels >= 2)
+		{
+			reverb.process(host[0], host[1], numSamples);
+			return;
+		}
+
+		// Mono: same signal on both sides of the upmix, average the downmix
+		auto mono = host[0];
+		Array out = {};
+		std::array<double, 2> in = {};
+
+		for (int start = 0; start < numSamples; start += reverb.stageBlockSize)
+		{
+			const int length = std::min(reverb.stageBlockSize, numSamples - start);
+			for (int i = 0; i < length; i++)
+			{
+				in[0] = in[1] = mono[start + i];
+				reverb.mix.stereoToMulti(in, reverb.inputFrames[i]);
+			}
+
+			reverb.processWetBlock(reverb.inputFrames.data(), reverb.wetFrames.data(), length);
+
+			for (int i = 0; i < length; i++)
+			{
+				for (int c = 0; c < channels; ++c)
+				{
+					out[c] = (reverb.dry * reverb.mixedDryGain * reverb.inputFrames[i][c] + reverb.wetFrames[i][c]) * reverb.scalingFactor;
+				}
+
+				reverb.mix.multiToStereo(out, in);
+				mono[start + i] = 0.5 * (in[0] + in[1]);
+			}
+		}
+	}
+};
+
+
+// True stereo: separate networks for the left and right inputs, so the tail keeps the input
+// position. The two networks share their delay times and run interleaved (see FDN_Reverb.h),
+// so every mixing step covers both at once. Each network's tail favours its own side.
+template<int channels = 8, int diffusionSteps = 4>
+class TrueStereoReverbEngine : public BasicReverbEngine<channels, diffusionSteps, 2> {
+	using Array = std::array<double, channels>;
+	using Interleaved = std::array<double, 2 * channels>;
+
+	// Same side, other side (about -8 dB)
+	const double nearGain = std::cos(M_PI / 8);
+	const double farGain = std::sin(M_PI / 8);
+
+public:
+	TrueStereoReverbEngine() : BasicReverbEngine<channels, diffusionSteps, 2>(2) {}
+
+	const char* getName() const override { return "True stereo"; }
+
+	double getDryScale() const override
+	{
+		return this->reverb.mixedDryGain * (channels / 2) * this->reverb.scalingFactor;
+	}
+
+	void process(const ReverbEngine::BufferView<double>& io, int numSamples) override
+	{
+		ReverbEngine::dispatchStride(*this, io, numSamples);
+	}
+
+	template<class Channels>
+	void processChannels(const Channels& host, int numSamples)
+	{
+		auto &reverb = this->reverb;
+		Array fromLeft, fromRight;
+		std::array<double, 2> left{}, right{}, outLeft, outRight;
+
+		// Same dry level as the stereo engine's up/downmix
+		const double dryGain = reverb.dry * reverb.mixedDryGain * (channels / 2) * reverb.scalingFactor;
+
+		for (int start = 0; start < numSamples; start += reverb.stageBlockSize)
+		{
+			const int length = std::min(reverb.stageBlockSize, numSamples - start);
+			for (int i = 0; i < length; i++)
+			{
+				left[0] = host[0][start + i];
+				right[1] = host[1][start + i];
+				reverb.mix.stereoToMulti(left, fromLeft);
+				reverb.mix.stereoToMulti(right, fromRight);
+				Interleaved &in = reverb.inputFrames[i];
+				for (int c = 0; c < channels; ++c)
+				{
+					in[2 * c] = fromLeft[c];
+					in[2 * c + 1] = fromRight[c];
+				}
+			}
+
+			reverb.processWetBlock(reverb.inputFrames.data(), reverb.wetFrames.data(), length);
+
+			for (int i = 0; i < length; i++)
+			{
+				const Interleaved &wet = reverb.wetFrames[i];
+				for (int c = 0; c < channels; ++c)
+				{
+					fromLeft[c] = wet[2 * c];
+					fromRight[c] = wet[2 * c + 1];
+				}
+				reverb.mix.multiToStereo(fromLeft, outLeft);
+				reverb.mix.multiToStereo(fromRight, outRight);
+
+				left[0] = host[0][start + i];
+				right[1] = host[1][start + i];
+				host[0][start + i] = dryGain * left[0] + (nearGain * outLeft[0] + farGain * outRight[0]) * reverb.scalingFactor;
+				host[1][start + i] = dryGain * right[1] + (farGain * outLeft[1] + nearGain * outRight[1]) * reverb.scalingFactor;
+			}
+		}
+	}
+};
+
+
+// Stereo buses for headphones: the network channels are virtual speakers around the listener,
+// rendered through HRIRs (see BinauralRenderer.h). Only the wet signal is rendered, so the
+// dry stays where it is.
+template<int channels = 16, int diffusionSteps = 4>
+class BinauralReverbEngine : public BasicReverbEngine<channels, diffusionSteps> {
+	using Array = std::array<double, channels>;
+	BinauralRenderer<channels> renderer;
+	// Decorrelated sources: same energy per ear as the stereo mixer's downmix
+	const double renderGain = std::sqrt(0.5 / channels);
+
+public:
+	BinauralReverbEngine() : BasicReverbEngine<channels, diffusionSteps>(2) {}
+
+	void configure(double sampleRate) override
+	{
+		BasicReverbEngine<channels, diffusionSteps>::configure(sampleRate);
+		renderer.configure(sampleRate);
+	}
+
+	const char* getName() const override { return "Binaural"; }
+
+	void process(const ReverbEngine::BufferView<double>& io, int numSamples) override
+	{
+		ReverbEngine::dispatchStride(*this, io, numSamples);
+	}
+
+	template<class Channels>
+	void processChannels(const Channels& host, int numSamples)
+	{
+		auto &reverb = this->reverb;
+		std::array<double, 2> stereo;
+		double left, right;
+
+		for (int start = 0; start < numSamples; start += reverb.stageBlockSize)
+		{
+			const int length = std::min(reverb.stageBlockSize, numSamples - start);
+			for (int i = 0; i < length; i++)
+			{
+				stereo[0] = host[0][start + i];
+				stereo[1] = host[1][start + i];
+				reverb.mix.stereoToMulti(stereo, reverb.inputFrames[i]);
+			}
+
+			reverb.processWetBlock(reverb.inputFrames.data(), reverb.wetFrames.data(), length);
+
+			for (int i = 0; i < length; i++)
+			{
+				Array &wet = reverb.wetFrames[i];
+				for (int c = 0; c < channels; ++c) wet[c] *= renderGain;
+				renderer.process(wet, left, right);
+
+				host[0][start + i] = reverb.dry * host[0][start + i] + left;
+				host[1][start + i] = reverb.dry * host[1][start + i] + right;
+			}
+		}
+	}
+};
+
+
+// Surround buses. The network channels map straight onto the host channels (LFE excluded):
+// network channel c is fed from, and feeds, host channel c % numReverbChannels. Each host
+// output therefore takes its own disjoint set of network channels, so the outputs are decorrelated.
+template<int channels, int diffusionSteps = 4>
+class SurroundReverbEngine : public BasicReverbEngine<channels, diffusionSteps> {
+	using Array = std::array<double, channels>;
+
+	int numReverbChannels;
+	std::array<int, channels> hostChannel;   // host channel for each network channel
+	std::array<double, channels> inputGain;  // includes a polarity flip for repeated host channels
+	std::array<double, channels> outputGain;
+
+public:
+	// lfeChannel is the host index of the LFE channel, or -1
+	SurroundReverbEngine(int numHostChannels, int lfeChannel)
+		: BasicReverbEngine<channels, diffusionSteps>(numHostChannels)
+	{
+		std::array<int, ReverbEngine::maxChannels> reverbToHost{};
+		numReverbChannels = 0;
+		for (int h = 0; h < numHostChannels && h < ReverbEngine::maxChannels; ++h)
+		{
+			if (h != lfeChannel) reverbToHost[numReverbChannels++] = h;
+		}
+
+		std::array<int, ReverbEngine::maxChannels> copies{};
+		for (int c = 0; c < channels; ++c) ++copies[c % numReverbChannels];
+
+		// Keep the total energy through the network about the same as the stereo engine
+		double inputScale = std::sqrt(double(numReverbChannels) / channels);
+		for (int c = 0; c < channels; ++c)
+		{
+			int r = c % numReverbChannels;
+			double polarity = ((c / numReverbChannels) % 2) ? -1.0 : 1.0;
+			hostChannel[c] = reverbToHost[r];
+			inputGain[c] = polarity * inputScale;
+			outputGain[c] = polarity * std::sqrt(0.5 / copies[r]);
+		}
+	}
+
+	const char* getName() const override { return "Surround"; }
+
+	void process(const ReverbEngine::BufferView<double>& io, int numSamples) override
+	{
+		ReverbEngine::dispatchStride(*this, io, numSamples);
+	}
+
+	template<class Channels>
+	void processChannels(const Channels& host, int numSamples)
+	{
+		auto &reverb = this->reverb;
+		std::array<double, ReverbEngine::maxChannels> out;
+
+		for (int start = 0; start < numSamples; start += reverb.stageBlockSize)
+		{
+			const int length = std::min(reverb.stageBlockSize, numSamples - start);
+			for (int i = 0; i < length; i++)
+			{
+				for (int c = 0; c < channels; ++c)
+				{
+					reverb.inputFrames[i][c] = host[hostChannel[c]][start + i] * inputGain[c];
+				}
+			}
+
+			reverb.processWetBlock(reverb.inputFrames.data(), reverb.wetFrames.data(), length);
+
+			for (int i = 0; i < length; i++)
+			{
+				const Array &wet = reverb.wetFrames[i];
+				// Dry stays on its own channel (including LFE), the wet goes everywhere but the LFE
+				for (int h = 0; h < this->numHostChannels; ++h)
+				{
+					out[h] = reverb.dry * host[h][start + i];
+				}
+				for (int c = 0; c < channels; ++c)
+				{
+					out[hostChannel[c]] += wet[c] * outputGain[c];
+				}
+				for (int h = 0; h < this->numHostChannels; ++h)
+				{
+					host[h][start + i] = out[h];
+				}
+			}
+		}
+	}
+};
+
+
+// Ambisonic buses (AmbiX, up to 3rd order). Every network channel is a virtual source at its
+// own direction: the output encodes it there, and the input is decoded to those directions with
+// a projection (sampling) decoder. Both matrices are computed once, up front.
+template<int channels = 16, int diffusionSteps = 4>
+class AmbisonicReverbEngine : public BasicReverbEngine<channels, diffusionSteps> {
+	using Array = std::array<double, channels>;
+	static constexpr int maxAmbisonicChannels = ambisonicChannels(3);
+
+	std::array<Array, maxAmbisonicChannels> encode;  // [ambisonic channel][network channel]
+	std::array<Array, maxAmbisonicChannels> decode;
+
+public:
+	explicit AmbisonicReverbEngine(int order)
+		: BasicReverbEngine<channels, diffusionSteps>(ambisonicChannels(std::max(1, std::min(order, 3))))
+	{
+		order = std::max(1, std::min(order, 3));
+
+		const auto directions = fibonacciSphere<channels>();
+		// Decorrelated sources: same energy per output as the stereo mixer's downmix
+		const double encodeGain = std::sqrt(0.5 / channels);
+		// Beam weights (2l + 1) peak at (order + 1)^2 towards the source, and the beam's mean square
+		// over the sphere is 1/(order + 1)^2. Scaling by 1/(order + 1) makes a plane wave drive the
+		// network about as hard as the stereo upmix does.
+		const double decodeGain = 1.0 / (order + 1);
+
+		for (auto &row : encode) row.fill(0);
+		for (auto &row : decode) row.fill(0);
+
+		std::array<double, maxAmbisonicChannels> harmonics;
+		for (int c = 0; c < channels; ++c)
+		{
+			sphericalHarmonicsSN3D(directions[c], order, harmonics);
+			for (int a = 0; a < this->numHostChannels; ++a)
+			{
+				int degree = static_cast<int>(std::sqrt(double(a)));
+				encode[a][c] = harmonics[a] * encodeGain;
+				decode[a][c] = harmonics[a] * (2 * degree + 1) * decodeGain;
+			}
+		}
+	}
+
+	const char* getName() const override { return "Ambisonic"; }
+
+	void process(const ReverbEngine::BufferView<double>& io, int numSamples) override
+	{
+		ReverbEngine::dispatchStride(*this, io, numSamples);
+	}
+
+	template<class Channels>
+	void processChannels(const Channels& host, int numSamples)
+	{
+		auto &reverb = this->reverb;
+
+		for (int start = 0; start < numSamples; start += reverb.stageBlockSize)
+		{
+			const int length = std::min(reverb.stageBlockSize, numSamples - start);
+			for (int i = 0; i < length; i++)
+			{
+				Array &in = reverb.inputFrames[i];
+				in.fill(0);
+				for (int a = 0; a < this->numHostChannels; ++a)
+				{
+					const double sample = host[a][start + i];
+					for (int c = 0; c < channels; ++c) in[c] += decode[a][c] * sample;
+				}
+			}
+
+			reverb.processWetBlock(reverb.inputFrames.data(), reverb.wetFrames.data(), length);
+
+			for (int i = 0; i < length; i++)
+			{
+				const Array &wet = reverb.wetFrames[i];
+				for (int a = 0; a < this->numHostChannels; ++a)
+				{
+					double out = reverb.dry * host[a][start + i];
+					for (int c = 0; c < channels; ++c) out += encode[a][c] * wet[c];
+					host[a][start + i] = out;
+				}
+			}
+		}
+	}
+};
+
+
+// Quality tiers, most expensive first. GovernedReverbEngine steps through them under CPU pressure,
+// and uses the high tier for offline renders.
+enum class EngineTier : int {
+	high = 0,  // offline only: twice the network channels (where the mapping allows), 6 diffusion steps
+	full,      // 4 diffusion steps
+	reduced,   // 2 diffusion steps
+	minimal,   // also half the network channels (where the mapping allows) and no early reflections
+	count
+};
+
+template<template<int, int> class Engine, int highChannels, int channels, int minimalChannels, class... Args>
+std::unique_ptr<ReverbEngine> createEngineTier(EngineTier tier, Args... args)
+{
+	if (tier == EngineTier::high)
+		return std::make_unique<Engine<highChannels, 6>>(args...);
+
+	if (tier == EngineTier::reduced)
+		return std::make_unique<Engine<channels, 2>>(args...);
+
+	if (tier == EngineTier::minimal)
+	{
+		auto engine = std::make_unique<Engine<minimalChannels, 2>>(args...);
+		engine->setEarlyReflectionsEnabled(false);
+		return engine;
+	}
+
+	return std::make_unique<Engine<channels, 4>>(args...);
+}
+
+// Picks the network size and mapping for a host layout.
+// ambisonicOrder is -1 for speaker layouts, stereoMode only applies to stereo buses.
+inline std::unique_ptr<ReverbEngine> createReverbEngine(int numHostChannels, int lfeChannel, int ambisonicOrder = -1,
+                                                        StereoMode stereoMode = StereoMode::stereo,
+                                                        EngineTier tier = EngineTier::full)
+{
+	if (ambisonicOrder > 0)
+		return createEngineTier<AmbisonicReverbEngine, 32, 16, 8>(tier, ambisonicOrder);
+
+	if (numHostChannels == 2 && stereoMode == StereoMode::binaural)
+		return createEngineTier<BinauralReverbEngine, 32, 16, 8>(tier);
+
+	if (numHostChannels == 2 && stereoMode == StereoMode::trueStereo)
+		return createEngineTier<TrueStereoReverbEngine, 16, 8, 4>(tier);
+
+	if (numHostChannels <= 2)
+		return createEngineTier<StereoReverbEngine, 16, 8, 4>(tier, numHostChannels);
+
+	// Surround maps network channels onto speakers one to one, so only the diffusion changes
+	int numReverbChannels = numHostChannels - (lfeChannel >= 0 ? 1 : 0);
+	if (numReverbChannels <= 8)
+		return createEngineTier<SurroundReverbEngine, 8, 8, 8>(tier, numHostChannels, lfeChannel);
+
+	return createEngineTier<SurroundReverbEngine, 16, 16, 16>(tier, numHostChannels, lfeChannel);
+}
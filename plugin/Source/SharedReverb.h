@@ -0,0 +1,546 @@
+
+/*
+  ==============================================================================
+
+Shared engines: plugin instances with the same engine ID (and the same bus
+layout, sample rate and block size) feed one process-wide network instead of
+running one each.
+
+Like a send and return:
+  - every member submits its input, times its send level, into its own slot
+  - once per host cycle, one member sums the slots and runs the engine
+  - the group's return (the member that joined first, or the oldest one left)
+    outputs the wet signal, and its settings drive the engine. The other
+    members' settings are ignored, apart from dry and send. If the return
+    stops being processed (bypassed, or muted in a host that then skips it),
+    the next member to notice takes over, so the group doesn't go silent.
+  - every member outputs its own dry signal
+
+By linearity, the return's wet is the sum of the wets the members would have
+produced on their own, so the mix is the same when the tracks are summed at
+unity. Faders and pans after the insert then no longer apply to the wet,
+as with any send.
+
+Host cycles: hosts process the members in any order, possibly on several
+threads. Each cycle is a generation. A member submits into the current
+generation, and whoever submits last runs the engine and starts the next
+generation. If a member isn't processed in a cycle (bypassed, or the host
+skips it), the first member to come back for a second time in the same
+generation runs it instead. So the wet comes out one block late, and members
+delay their output by the largest block size to keep a fixed latency
+(reported to the host).
+
+Nobody waits for anybody:
+  - a member that finds the generation already being run by someone else
+    submits into the next one
+  - the run takes each slot it sums (by swapping the slot's generation for a
+    taken one). A member checks after submitting whether a run has started
+    meanwhile; if so and its slot wasn't taken, it moves the submission on to
+    the next generation, so no send is dropped.
+  - a member whose generation isn't finished by its next block repeats the
+    wet of the generation before for that block
+
+Nothing on the audio thread allocates, locks or waits. Joining and leaving
+happen on the message thread.
+
+No JUCE in here.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "ReverbEngine.h"
+#include "ParameterEvents.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+class SharedReverbMember;
+
+
+// Members with equal keys share an engine
+struct SharedReverbKey {
+	int engineId = 0;
+	int numHostChannels = 2;
+	int lfeChannel = -1;
+	int ambisonicOrder = -1;
+	StereoMode stereoMode = StereoMode::stereo;
+	double sampleRate = 48000;
+	int maxBlockSize = 512;
+
+	bool operator==(const SharedReverbKey& other) const
+	{
+		return engineId == other.engineId && numHostChannels == other.numHostChannels && lfeChannel == other.lfeChannel
+			&& ambisonicOrder == other.ambisonicOrder && stereoMode == other.stereoMode
+			&& sampleRate == other.sampleRate && maxBlockSize == other.maxBlockSize;
+	}
+};
+
+
+class SharedReverbGroup {
+public:
+	static constexpr int maxMembers = 128;
+	static constexpr uint64_t idleGenerations = 2;  // a return that misses more cycles than this is replaced
+
+	// Allocates and configures the engine, so never on the audio thread
+	SharedReverbGroup(const SharedReverbKey& key, uint32_t seed)
+		: key(key), engine(createReverbEngine(key.numHostChannels, key.lfeChannel, key.ambisonicOrder, key.stereoMode))
+	{
+		engine->setSeed(seed);
+		engine->setDry(0);  // each member adds its own
+		engine->configure(key.sampleRate);
+
+		for (auto &generation : wet)
+		{
+			for (int c = 0; c < key.numHostChannels; ++c) generation.channels[c].assign(size_t(key.maxBlockSize), 0.0);
+		}
+		for (int c = 0; c < key.numHostChannels; ++c) sum[c].assign(size_t(key.maxBlockSize), 0.0);
+	}
+
+	const SharedReverbKey key;
+
+	const char* getName() const { return engine->getName(); }
+	int getNetworkChannels() const { return engine->getNetworkChannels(); }
+	double getDryScale() const { return engine->getDryScale(); }
+	int getNumMembers() const { return numMembers.load(std::memory_order_relaxed); }
+
+private:
+	friend class SharedReverbMember;
+	friend class SharedReverbRegistry;
+
+	static constexpr uint64_t never = ~uint64_t(0);
+	static constexpr uint64_t taken = uint64_t(1) << 62;  // flag on a slot's generation: summed into its run
+
+	static uint64_t generationOf(uint64_t submitted) { return submitted == never ? never : submitted & ~taken; }
+
+	struct Slot {
+		std::atomic<bool> active{false};
+		std::atomic<uint64_t> submitted{never};  // generation of the last submission, maybe taken
+		std::atomic<uint64_t> seen{0};           // the current generation at its last block
+		// By generation parity
+		std::array<int, 2> length{};
+		std::array<std::array<std::vector<double>, ReverbEngine::maxChannels>, 2> input;
+	};
+
+	// Output of one generation
+	struct Wet {
+		int length = 0;
+		std::array<std::vector<double>, ReverbEngine::maxChannels> channels;
+	};
+
+	std::unique_ptr<ReverbEngine> engine;  // whoever runs the generation
+	std::array<Slot, maxMembers> slots;
+	std::atomic<int> numMembers{0};
+	std::atomic<int> returnSlot{-1};
+
+	alignas(64) std::atomic<uint64_t> generation{0};  // the one being submitted into
+	alignas(64) std::atomic<uint64_t> claimed{0};     // generations that someone has started running
+	std::array<std::atomic<int>, 4> arrivals{};       // submissions, by generation
+	std::array<Wet, 4> wet;                           // by generation, so a slow reader isn't overwritten
+	std::array<std::vector<double>, ReverbEngine::maxChannels> sum;
+
+	// From the return, applied before each run
+	PendingParameters parameters;
+	std::atomic<bool> retrigger{false};
+
+	// Message thread, with the registry lock held
+	int join()
+	{
+		for (int s = 0; s < maxMembers; ++s)
+		{
+			auto &slot = slots[s];
+			if (slot.active.load())
+				continue;
+			for (auto &parity : slot.input)
+			{
+				for (int c = 0; c < key.numHostChannels; ++c) parity[c].resize(size_t(key.maxBlockSize));
+			}
+			slot.seen.store(generation.load());
+			slot.active.store(true);
+			numMembers.fetch_add(1);
+			if (returnSlot.load() < 0) returnSlot.store(s);
+			return s;
+		}
+		return -1;
+	}
+
+	void leave(int s)
+	{
+		// A submission nobody has taken is dropped. The one before it (or a taken one) may still be
+		// being read, so the slot keeps it: whoever joins into this slot next submits to the other parity.
+		auto &slot = slots[s];
+		slot.active.store(false);
+		uint64_t submitted = slot.submitted.load();
+		while (submitted != never && !(submitted & taken)
+			&& !slot.submitted.compare_exchange_weak(submitted, submitted == 0 ? never : (submitted - 1) | taken)) {}
+		numMembers.fetch_sub(1);
+		if (returnSlot.load() != s)
+			return;
+
+		// The oldest remaining member isn't known, so the lowest slot takes over
+		int next = -1;
+		for (int other = 0; other < maxMembers && next < 0; ++other)
+		{
+			if (slots[other].active.load()) next = other;
+		}
+		returnSlot.store(next);
+	}
+
+	// Audio thread: runs generation g, unless it isn't the current one or someone else already is.
+	// Then runs the next one too if everybody has submitted to it meanwhile.
+	void complete(uint64_t g)
+	{
+		while (generation.load(std::memory_order_acquire) == g)
+		{
+			uint64_t expected = g;
+			if (!claimed.compare_exchange_strong(expected, g + 1))
+				return;
+			run(g);
+
+			arrivals[(g + 2) & 3].store(0, std::memory_order_relaxed);  // before anyone can submit to g + 2
+			generation.store(g + 1, std::memory_order_release);
+			++g;
+			if (arrivals[g & 3].load(std::memory_order_acquire) < numMembers.load(std::memory_order_relaxed))
+				return;
+		}
+	}
+
+	void run(uint64_t g)
+	{
+		const int numChannels = key.numHostChannels;
+		const int parity = int(g & 1);
+
+		// Take the slots submitted so far. Later submissions see the claim and move on to g + 1.
+		std::array<int, maxMembers> members;
+		int count = 0, length = 0;
+		for (int s = 0; s < maxMembers; ++s)
+		{
+			uint64_t expected = g;
+			if (slots[s].submitted.compare_exchange_strong(expected, g | taken))
+			{
+				members[count++] = s;
+				length = std::max(length, slots[s].length[parity]);
+			}
+		}
+		for (int c = 0; c < numChannels; ++c) std::fill(sum[c].begin(), sum[c].begin() + length, 0.0);
+		for (int m = 0; m < count; ++m)
+		{
+			const auto &slot = slots[members[m]];
+			for (int c = 0; c < numChannels; ++c)
+			{
+				const double* in = slot.input[parity][c].data();
+				for (int i = 0; i < slot.length[parity]; ++i) sum[c][i] += in[i];
+			}
+		}
+
+		parameters.drain([this](ParamId id, float value) { apply(id, value); });
+		if (retrigger.exchange(false))
+			engine->retriggerModulation();
+
+		std::array<double*, ReverbEngine::maxChannels> channels{};
+		for (int c = 0; c < numChannels; ++c) channels[c] = sum[c].data();
+		if (length > 0)
+			engine->process(channels.data(), length);
+
+		auto &out = wet[g & 3];
+		for (int c = 0; c < numChannels; ++c) std::copy(sum[c].begin(), sum[c].begin() + length, out.channels[c].begin());
+		out.length = length;
+	}
+
+	void apply(ParamId id, float value)
+	{
+		switch (id)
+		{
+			case ParamId::size:           engine->setRoomSize(value); break;
+			case ParamId::decay:          engine->setDecay(value); break;
+			case ParamId::diffuser:       engine->setDiffusionGain(value); break;
+			case ParamId::wetReflections: engine->setEarlyReflections(value); break;
+			case ParamId::preDelay:       engine->setPreDelay(value); break;
+			case ParamId::modRate:        engine->setModulationRate(value); break;  // in Hz, after tempo sync
+			case ParamId::modDepth:       engine->setModulationDepth(value); break;
+			default: break;
+		}
+	}
+};
+
+
+// One plugin instance's membership. Created and destroyed on the message thread,
+// process() and the setters on that instance's audio thread.
+class SharedReverbMember {
+public:
+	SharedReverbMember(std::shared_ptr<SharedReverbGroup> group, int slot);
+	~SharedReverbMember();
+
+	SharedReverbGroup& getGroup() const { return *group; }
+
+	// Any thread
+	bool isReturn() const { return group->returnSlot.load(std::memory_order_relaxed) == slot; }
+
+	// Output is delayed by the largest block
+	int getLatencySamples() const { return latency; }
+
+	// Audio thread. Takes dry, send and the engine settings (forwarded while this is the return).
+	// Returns false for anything else.
+	bool setParameter(ParamId id, float value)
+	{
+		switch (id)
+		{
+			case ParamId::dry:            dryLevel = value; return true;
+			case ParamId::sharedSend:     send = value; return true;
+			case ParamId::size:
+			case ParamId::decay:
+			case ParamId::diffuser:
+			case ParamId::wetReflections:
+			case ParamId::preDelay:
+			case ParamId::modDepth:       setEngineParameter(id, value); return true;
+			default:                      return false;
+		}
+	}
+
+	void setModulationRate(double rateHz) { setEngineParameter(ParamId::modRate, static_cast<float>(rateHz)); }
+
+	void retriggerModulation()
+	{
+		if (isReturn()) group->retrigger.store(true, std::memory_order_relaxed);
+	}
+
+	// Audio thread, once per host block. One pointer per host channel, processed in place.
+	template<typename Sample>
+	void process(Sample* const* channels, int numSamples)
+	{
+		for (int start = 0; start < numSamples; start += latency)
+		{
+			std::array<Sample*, ReverbEngine::maxChannels> piece{};
+			for (int c = 0; c < numChannels; ++c) piece[c] = channels[c] + start;
+			processBlock(piece.data(), std::min(latency, numSamples - start));
+		}
+	}
+
+private:
+	std::shared_ptr<SharedReverbGroup> group;
+	const int slot;
+	const int numChannels;
+	const int latency;
+	const double dryScale;
+
+	float dryLevel = 0.5f;
+	float send = 1.0f;
+
+	// Latest engine settings, sent again when this member becomes the return
+	std::array<float, numParams> engineValues{};
+	uint32_t knownValues = 0;
+	bool wasReturn = false;
+
+	// Dry and wet, delayed by `latency`
+	std::array<std::vector<double>, ReverbEngine::maxChannels> dryDelay, wetDelay;
+	uint32_t mask = 0;
+	uint32_t position = 0;
+	int previousLength = 0;  // this member's share of the last generation it submitted to
+	uint64_t previousGeneration = SharedReverbGroup::never;
+
+	void setEngineParameter(ParamId id, float value)
+	{
+		engineValues[static_cast<int>(id)] = value;
+		knownValues |= 1u << static_cast<int>(id);
+		if (isReturn()) group->parameters.set(id, value);
+	}
+
+	template<typename Sample>
+	void processBlock(Sample* const* channels, int numSamples)
+	{
+		auto &shared = *group;
+		auto &own = shared.slots[slot];
+
+		// Back for a second time in the same generation: the host has moved on without the rest
+		const uint64_t last = SharedReverbGroup::generationOf(own.submitted.load(std::memory_order_acquire));
+		if (last == shared.generation.load(std::memory_order_acquire))
+			shared.complete(last);
+		const uint64_t current = shared.generation.load(std::memory_order_acquire);
+		own.seen.store(current, std::memory_order_relaxed);
+
+		// The return has stopped coming (bypassed, or skipped by the host): this member takes over
+		int returnSlot = shared.returnSlot.load(std::memory_order_relaxed);
+		if (returnSlot >= 0 && returnSlot != slot
+			&& current > shared.slots[returnSlot].seen.load(std::memory_order_relaxed) + SharedReverbGroup::idleGenerations)
+			shared.returnSlot.compare_exchange_strong(returnSlot, slot, std::memory_order_relaxed);
+
+		const bool returning = isReturn();
+		if (returning && !wasReturn)
+		{
+			for (int i = 0; i < numParams; ++i)
+			{
+				if (knownValues & (1u << i)) shared.parameters.set(static_cast<ParamId>(i), engineValues[i]);
+			}
+		}
+		wasReturn = returning;
+
+		// The wet of the last generation this member was in into the wet delay, or if that's still
+		// running, the one before again. Runs of current and current + 1 may be writing their own
+		// entries meanwhile, so only the two generations before are safe to read. After missing more
+		// cycles, that block stays dry.
+		if (previousGeneration != SharedReverbGroup::never && returning)
+		{
+			const uint64_t source = previousGeneration < current ? previousGeneration : previousGeneration - 1;
+			if (source < current && current - source <= 2)
+			{
+				const auto &out = shared.wet[source & 3];
+				const uint32_t start = position - uint32_t(previousLength);
+				for (int c = 0; c < numChannels; ++c)
+				{
+					for (int i = 0; i < previousLength; ++i)
+						wetDelay[c][(start + uint32_t(i)) & mask] = i < out.length ? out.channels[c][i] : 0.0;
+				}
+
+				// The others ran two more generations during the copy, and the run of source + 4 has
+				// started on this entry: that block stays dry too. (A read-modify-write, so the copy
+				// can't move after it.)
+				if (shared.claimed.fetch_add(0, std::memory_order_acq_rel) > source + 4)
+				{
+					for (int c = 0; c < numChannels; ++c)
+					{
+						for (int i = 0; i < previousLength; ++i) wetDelay[c][(start + uint32_t(i)) & mask] = 0.0;
+					}
+				}
+			}
+		}
+
+		// Into the current generation, or the next one if this member is already in the current one
+		// (someone else is running it). Two ahead would share input buffers with the running one:
+		// then this block doesn't go to the engine.
+		uint64_t g = current;
+		if (last != SharedReverbGroup::never && last >= g) g = last + 1;
+		const bool submitting = g <= current + 1;
+
+		const int parity = int(g & 1);
+		for (int c = 0; c < numChannels; ++c)
+		{
+			double* in = own.input[parity][c].data();
+			for (int i = 0; i < numSamples; ++i)
+			{
+				const double x = static_cast<double>(channels[c][i]);
+				if (submitting) in[i] = x * send;
+				dryDelay[c][(position + uint32_t(i)) & mask] = x;
+				wetDelay[c][(position + uint32_t(i)) & mask] = 0.0;  // until its generation is done
+			}
+		}
+		previousLength = numSamples;
+		previousGeneration = SharedReverbGroup::never;
+
+		if (submitting)
+		{
+			own.length[g & 1] = numSamples;
+			own.submitted.store(g);
+
+			// A run of g that started before the store may have missed this slot. If it didn't take
+			// it, move the submission on to the next generation.
+			while (shared.claimed.load() > g)
+			{
+				uint64_t expected = g;
+				if (!own.submitted.compare_exchange_strong(expected, SharedReverbGroup::never))
+					break;  // taken
+				for (int c = 0; c < numChannels; ++c)
+					std::copy_n(own.input[g & 1][c].begin(), numSamples, own.input[(g + 1) & 1][c].begin());
+				++g;
+				own.length[g & 1] = numSamples;
+				own.submitted.store(g);
+			}
+			previousGeneration = g;
+
+			// Last one in runs it
+			if (shared.arrivals[g & 3].fetch_add(1, std::memory_order_acq_rel) + 1 >= shared.numMembers.load(std::memory_order_relaxed))
+				shared.complete(g);
+		}
+
+		// Output from `latency` samples ago
+		const double dryGain = dryLevel * dryScale;
+		const uint32_t delayed = position - uint32_t(latency);
+		for (int c = 0; c < numChannels; ++c)
+		{
+			for (int i = 0; i < numSamples; ++i)
+			{
+				const uint32_t index = (delayed + uint32_t(i)) & mask;
+				channels[c][i] = static_cast<Sample>(dryGain * dryDelay[c][index] + wetDelay[c][index]);
+			}
+		}
+		position += uint32_t(numSamples);
+	}
+};
+
+
+// Process-wide: every plugin instance loaded from this binary sees the same one
+class SharedReverbRegistry {
+public:
+	static SharedReverbRegistry& instance()
+	{
+		static SharedReverbRegistry registry;
+		return registry;
+	}
+
+	// Message thread. Creates the group if it's the first member (with this member's seed).
+	// Returns nullptr if the group is full.
+	std::unique_ptr<SharedReverbMember> join(const SharedReverbKey& key, uint32_t seed)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::shared_ptr<SharedReverbGroup> group;
+		for (auto it = groups.begin(); it != groups.end();)
+		{
+			auto existing = it->lock();
+			if (existing == nullptr)
+			{
+				it = groups.erase(it);
+				continue;
+			}
+			if (existing->key == key) group = existing;
+			++it;
+		}
+		if (group == nullptr)
+		{
+			group = std::make_shared<SharedReverbGroup>(key, seed);
+			groups.push_back(group);
+		}
+
+		const int slot = group->join();
+		if (slot < 0)
+			return nullptr;
+		return std::make_unique<SharedReverbMember>(std::move(group), slot);
+	}
+
+private:
+	friend class SharedReverbMember;
+
+	std::mutex mutex;
+	std::vector<std::weak_ptr<SharedReverbGroup>> groups;
+
+	void leave(SharedReverbGroup& group, int slot)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		group.leave(slot);
+	}
+};
+
+
+inline SharedReverbMember::SharedReverbMember(std::shared_ptr<SharedReverbGroup> newGroup, int slot)
+	: group(std::move(newGroup)), slot(slot), numChannels(group->key.numHostChannels),
+	  latency(std::max(1, group->key.maxBlockSize)), dryScale(group->getDryScale())
+{
+	size_t size = 1;
+	while (size < 2 * size_t(latency)) size *= 2;
+	for (int c = 0; c < numChannels; ++c)
+	{
+		dryDelay[c].assign(size, 0.0);
+		wetDelay[c].assign(size, 0.0);
+	}
+	mask = uint32_t(size - 1);
+}
+
+inline SharedReverbMember::~SharedReverbMember()
+{
+	SharedReverbRegistry::instance().leave(*group, slot);
+}
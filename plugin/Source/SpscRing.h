@@ -0,0 +1,43 @@
+
+/*
+  ==============================================================================
+
+Wait-free single-producer/single-consumer ring, for telemetry that goes from
+the audio thread to the message thread (stage timing, CPU load).
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+
+// Wait-free for one producer and one consumer. push() fails when full.
+template<class Item, int capacity = 1024>
+class SpscRing {
+	static_assert((capacity & (capacity - 1)) == 0, "capacity must be a power of two");
+
+	std::array<Item, capacity> items;
+	alignas(64) std::atomic<uint32_t> writeIndex{0};
+	alignas(64) std::atomic<uint32_t> readIndex{0};
+
+public:
+	bool push(const Item& item) {
+		uint32_t write = writeIndex.load(std::memory_order_relaxed);
+		if (write - readIndex.load(std::memory_order_acquire) == capacity) return false;
+		items[write%capacity] = item;
+		writeIndex.store(write + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(Item& item) {
+		uint32_t read = readIndex.load(std::memory_order_relaxed);
+		if (read == writeIndex.load(std::memory_order_acquire)) return false;
+		item = items[read%capacity];
+		readIndex.store(read + 1, std::memory_order_release);
+		return true;
+	}
+};
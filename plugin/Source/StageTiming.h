@@ -0,0 +1,173 @@
+
+/*
+  ==============================================================================
+
+Per-stage timing of the reverb network (opt-in, compile-time).
+
+Build with -DREVERB_STAGE_TIMING=ON (CMake) to turn it on. Otherwise none of
+this is compiled into the engines, and the laps in FDN_Reverb.h are empty.
+
+The audio thread adds up the clock ticks spent in each stage (rdtsc on x86,
+steady_clock elsewhere) over a block, and pushes one record per block into a
+wait-free single-producer/single-consumer ring. The message thread drains the
+ring into StageTimingStats for min/mean/p99 per stage. If nobody drains it,
+records are dropped (and counted) rather than blocking the audio thread.
+
+BasicReverb::processWetBlock() runs each stage over a block (up to
+BasicReverb::stageBlockSize frames) before the next, so there's one lap per
+stage per block, not per sample. "Output" is everything outside the four
+network stages: the wet sum, the engine's channel mapping and the parameter
+glide. The delay modulation is charged to the diffuser, whose pass runs it.
+
+The editor shows the summary, so the ring is only drained while it's open.
+
+No JUCE in here.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#ifndef REVERB_STAGE_TIMING
+	#define REVERB_STAGE_TIMING 0
+#endif
+
+#include "SpscRing.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	#include <intrin.h>
+	#define REVERB_STAGE_TIMING_RDTSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+	#include <x86intrin.h>
+	#define REVERB_STAGE_TIMING_RDTSC 1
+#else
+	#define REVERB_STAGE_TIMING_RDTSC 0
+#endif
+
+
+enum class Stage : int {
+	earlyReflections = 0,
+	preDelay,
+	diffuser,
+	feedback,
+	output,
+	count
+};
+
+constexpr int stageCount = static_cast<int>(Stage::count);
+
+constexpr std::array<const char*, stageCount> stageNames = {
+	"Early reflections",
+	"Pre-delay",
+	"Diffuser",
+	"Feedback",
+	"Output"
+};
+
+// Cycles on x86 (reference cycles, not affected by frequency scaling), nanoseconds elsewhere
+inline uint64_t stageClock() {
+#if REVERB_STAGE_TIMING_RDTSC
+	return __rdtsc();
+#else
+	return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+
+struct StageTimingRecord {
+	uint32_t samples = 0;
+	std::array<uint64_t, stageCount> ticks{};
+};
+
+
+// Audio thread: lap() charges the time since the previous lap to a stage
+struct StageTimer {
+	SpscRing<StageTimingRecord> records;
+	std::atomic<uint32_t> dropped{0};
+
+	void beginBlock() {
+		current = {};
+		last = stageClock();
+	}
+
+	void lap(Stage stage) {
+		uint64_t now = stageClock();
+		current.ticks[static_cast<int>(stage)] += now - last;
+		last = now;
+	}
+
+	void endBlock(int numSamples) {
+		lap(Stage::output);
+		current.samples = uint32_t(numSamples);
+		if (!records.push(current)) dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+
+private:
+	StageTimingRecord current;
+	uint64_t last = 0;
+};
+
+
+// Message thread: ticks per sample for each stage, over the most recent blocks
+class StageTimingStats {
+public:
+	struct Summary {
+		struct Stat {
+			double min = 0, mean = 0, p99 = 0;
+		};
+		std::array<Stat, stageCount> stages;
+		int blocks = 0;
+		uint32_t dropped = 0;
+	};
+
+	explicit StageTimingStats(int windowBlocks = 2048) : window(size_t(std::max(windowBlocks, 1))) {}
+
+	// Allocation-free, but not for the audio thread (it's the consumer)
+	void drain(StageTimer& timer) {
+		StageTimingRecord record;
+		while (timer.records.pop(record)) {
+			if (record.samples == 0) continue;
+			window[next] = record;
+			next = (next + 1)%window.size();
+			count = std::min(count + 1, window.size());
+		}
+		dropped = timer.dropped.load(std::memory_order_relaxed);
+	}
+
+	Summary summary() const {
+		Summary result;
+		result.blocks = int(count);
+		result.dropped = dropped;
+		if (count == 0) return result;
+
+		std::vector<double> perSample(count);
+		for (int s = 0; s < stageCount; ++s) {
+			double sum = 0;
+			for (size_t i = 0; i < count; ++i) {
+				perSample[i] = double(window[i].ticks[s])/window[i].samples;
+				sum += perSample[i];
+			}
+			size_t p99Index = std::min(count - 1, count*99/100);
+			std::nth_element(perSample.begin(), perSample.begin() + p99Index, perSample.end());
+
+			auto &stat = result.stages[s];
+			stat.p99 = perSample[p99Index];
+			stat.min = *std::min_element(perSample.begin(), perSample.end());
+			stat.mean = sum/count;
+		}
+		return result;
+	}
+
+private:
+	std::vector<StageTimingRecord> window;
+	size_t next = 0, count = 0;
+	uint32_t dropped = 0;
+};
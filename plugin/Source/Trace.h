@@ -0,0 +1,257 @@
+
+/*
+  ==============================================================================
+
+Chrome trace-event export (opt-in, compile-time).
+
+Build with -DREVERB_TRACE=ON (CMake) to turn it on. Otherwise the REVERB_TRACE_*
+macros are empty and none of this is compiled in.
+
+Any thread records events (processBlock, parameter changes, configure/resize,
+silence bypass) into one preallocated lock-free buffer. While at least one
+Trace::Session is alive, a background thread writes them out as Chrome
+trace-event JSON, to $REVERB_TRACE_FILE or reverb-trace-<pid>.json in the
+temp directory. Open it in Perfetto (ui.perfetto.dev) or chrome://tracing.
+
+Timestamps come from steady_clock (CLOCK_MONOTONIC on Linux), so they line up
+with host traces taken on the same clock. If the writer falls behind, events
+are dropped rather than blocking the audio thread.
+
+No JUCE in here.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#ifndef REVERB_TRACE
+	#define REVERB_TRACE 0
+#endif
+
+#if REVERB_TRACE
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#if defined(_WIN32)
+	#include <process.h>
+#else
+	#include <unistd.h>
+#endif
+
+
+struct Trace {
+	struct Event {
+		uint64_t timeNs = 0;
+		const char* name = "";  // must be a string literal (or otherwise live forever)
+		double value = 0;
+		uint32_t thread = 0;
+		char phase = 'i';       // 'B'egin, 'E'nd, 'i'nstant
+		bool hasValue = false;
+	};
+
+	static void begin(const char* name) {
+		record('B', name);
+	}
+	static void end(const char* name) {
+		record('E', name);
+	}
+	static void instant(const char* name) {
+		record('i', name);
+	}
+	static void instant(const char* name, double value) {
+		record('i', name, value, true);
+	}
+
+	// Begin/end around a scope
+	struct Scope {
+		const char* name;
+		explicit Scope(const char* name) : name(name) {
+			begin(name);
+		}
+		~Scope() {
+			end(name);
+		}
+	};
+
+	// Writes the trace while any Session exists (one per plugin instance)
+	struct Session {
+		Session() {
+			auto &state = Trace::state();
+			std::lock_guard<std::mutex> lock(state.sessionMutex);
+			if (state.sessions++ == 0) state.start();
+		}
+		~Session() {
+			auto &state = Trace::state();
+			std::lock_guard<std::mutex> lock(state.sessionMutex);
+			if (--state.sessions == 0) state.stop();
+		}
+		Session(const Session&) = delete;
+		Session& operator=(const Session&) = delete;
+	};
+
+private:
+	static constexpr uint32_t capacity = 1 << 16;
+
+	// Bounded multi-producer queue (Vyukov): each cell's sequence says whose turn it is
+	struct Cell {
+		std::atomic<uint32_t> sequence{0};
+		Event event;
+	};
+
+	struct State {
+		std::array<Cell, capacity> cells;
+		alignas(64) std::atomic<uint32_t> writeIndex{0};
+		alignas(64) uint32_t readIndex = 0;  // writer thread only
+		std::atomic<uint32_t> dropped{0};
+		std::atomic<bool> recording{false};
+
+		std::mutex sessionMutex;
+		int sessions = 0;
+		std::thread writer;
+		std::atomic<bool> stopWriter{false};
+
+		State() {
+			for (uint32_t i = 0; i < capacity; ++i) cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+
+		bool push(const Event& event) {
+			uint32_t pos = writeIndex.load(std::memory_order_relaxed);
+			while (true) {
+				Cell &cell = cells[pos & (capacity - 1)];
+				int32_t diff = int32_t(cell.sequence.load(std::memory_order_acquire) - pos);
+				if (diff == 0) {
+					if (writeIndex.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+						cell.event = event;
+						cell.sequence.store(pos + 1, std::memory_order_release);
+						return true;
+					}
+				} else if (diff < 0) {
+					return false;  // full
+				} else {
+					pos = writeIndex.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		bool pop(Event& event) {
+			Cell &cell = cells[readIndex & (capacity - 1)];
+			if (int32_t(cell.sequence.load(std::memory_order_acquire) - (readIndex + 1)) < 0) return false;
+			event = cell.event;
+			cell.sequence.store(readIndex + capacity, std::memory_order_release);
+			++readIndex;
+			return true;
+		}
+
+		void start() {
+			stopWriter.store(false);
+			writer = std::thread([this] { writeLoop(); });
+			recording.store(true);
+		}
+
+		void stop() {
+			recording.store(false);
+			stopWriter.store(true);
+			if (writer.joinable()) writer.join();
+		}
+
+		static std::string fileName() {
+			if (const char* path = std::getenv("REVERB_TRACE_FILE")) return path;
+			auto name = "reverb-trace-" + std::to_string(processId()) + ".json";
+			return (std::filesystem::temp_directory_path()/name).string();
+		}
+
+		// JSON array format: the closing bracket is optional, so a crash still leaves a readable trace
+		void writeLoop() {
+			std::FILE* file = std::fopen(fileName().c_str(), "w");
+			if (file == nullptr) return;
+			std::fputs("[\n", file);
+
+			const int pid = processId();
+			bool first = true;
+			Event event;
+			bool stopping = false;
+			while (!stopping) {
+				stopping = stopWriter.load();  // one more pass after the last session ends
+				while (pop(event)) {
+					std::fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u",
+					             first ? "" : ",\n", event.name, event.phase, event.timeNs*0.001, pid, event.thread);
+					if (event.phase == 'i') std::fputs(",\"s\":\"t\"", file);
+					if (event.hasValue) std::fprintf(file, ",\"args\":{\"value\":%g}", event.value);
+					std::fputs("}", file);
+					first = false;
+				}
+				uint32_t lost = dropped.exchange(0);
+				if (lost > 0) {
+					std::fprintf(file, "%s{\"name\":\"dropped events\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%.3f,\"pid\":%d,\"tid\":0,\"args\":{\"value\":%u}}",
+					             first ? "" : ",\n", now()*0.001, pid, lost);
+					first = false;
+				}
+				std::fflush(file);
+				if (!stopping) std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			}
+			std::fputs("\n]\n", file);
+			std::fclose(file);
+		}
+	};
+
+	static State& state() {
+		static State instance;
+		return instance;
+	}
+
+	static uint64_t now() {
+		return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	static int processId() {
+#if defined(_WIN32)
+		return _getpid();
+#else
+		return int(getpid());
+#endif
+	}
+
+	// Small, stable IDs are easier to read in the trace viewer than OS thread IDs
+	static uint32_t threadId() {
+		static std::atomic<uint32_t> nextId{1};
+		thread_local uint32_t id = nextId.fetch_add(1);
+		return id;
+	}
+
+	static void record(char phase, const char* name, double value = 0, bool hasValue = false) {
+		auto &s = state();
+		if (!s.recording.load(std::memory_order_relaxed)) return;
+		Event event;
+		event.timeNs = now();
+		event.name = name;
+		event.value = value;
+		event.thread = threadId();
+		event.phase = phase;
+		event.hasValue = hasValue;
+		if (!s.push(event)) s.dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+};
+
+#define REVERB_TRACE_JOIN2(a, b) a##b
+#define REVERB_TRACE_JOIN(a, b) REVERB_TRACE_JOIN2(a, b)
+#define REVERB_TRACE_SCOPE(name) Trace::Scope REVERB_TRACE_JOIN(traceScope, __LINE__)(name)
+#define REVERB_TRACE_INSTANT(name) Trace::instant(name)
+#define REVERB_TRACE_VALUE(name, value) Trace::instant(name, value)
+
+#else
+
+#define REVERB_TRACE_SCOPE(name) do {} while (false)
+#define REVERB_TRACE_INSTANT(name) do {} while (false)
+#define REVERB_TRACE_VALUE(name, value) do {} while (false)
+
+#endif
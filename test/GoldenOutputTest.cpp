@@ -0,0 +1,124 @@
+
+/*
+  ==============================================================================
+
+Golden-output test: renders fixed stimuli through the engines with fixed
+seeds and parameters, and compares the output bit for bit against the files
+in test/golden (ReverbAnalysis.h has the format).
+
+Usage: golden_output_test <golden dir> [--update]
+
+--update writes the files instead. The files hold native doubles, and libm
+differs between platforms, so they're regenerated when the build machine
+changes, and otherwise only when a change to the sound is intended.
+
+  ==============================================================================
+*/
+
+#include "ReverbEngine.h"
+#include "ReverbAnalysis.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+
+namespace {
+
+struct GoldenCase {
+	const char* name;
+	int numHostChannels;
+	int lfeChannel;
+	int ambisonicOrder;
+	StereoMode stereoMode;
+	int pipelineBlockSize;  // 0 = serial
+};
+
+constexpr GoldenCase cases[] = {
+	{ "stereo_impulse",        2, -1, -1, StereoMode::stereo,     0 },
+	{ "true_stereo_noise",     2, -1, -1, StereoMode::trueStereo, 0 },
+	{ "binaural_sweep",        2, -1, -1, StereoMode::binaural,   0 },
+	{ "surround_5_1_impulse",  6,  3, -1, StereoMode::stereo,     0 },
+	{ "ambisonic_1_noise",     4, -1,  1, StereoMode::stereo,     0 },
+	{ "stereo_pipelined_noise", 2, -1, -1, StereoMode::stereo,    256 },
+};
+
+constexpr double sampleRate = 48000;
+constexpr int length = 2048;
+constexpr uint32_t seed = 12345;
+
+Signal render(const GoldenCase& test)
+{
+	auto engine = createReverbEngine(test.numHostChannels, test.lfeChannel, test.ambisonicOrder, test.stereoMode);
+	engine->setSeed(seed);
+	engine->setPipelineBlockSize(test.pipelineBlockSize);
+	engine->setRoomSize(30);
+	engine->setDecay(1.5);
+	engine->setDry(0.2);
+	engine->setDiffusionGain(0.5);
+	engine->setEarlyReflections(0.4);
+	engine->setPreDelay(2);
+	engine->setModulationDepth(0.5);
+	engine->setModulationRate(1.5);
+
+	const std::string name = test.name;
+	std::vector<double> stimulus;
+	if (name.find("impulse") != std::string::npos)
+		stimulus = impulseStimulus(length);
+	else if (name.find("sweep") != std::string::npos)
+		stimulus = sineSweepStimulus(length, length / 2, sampleRate);
+	else
+		stimulus = noiseBurstStimulus(length, length / 8, seed);
+	return renderStimulus(*engine, sampleRate, stimulus);
+}
+
+}  // namespace
+
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		std::printf("Usage: %s <golden dir> [--update]\n", argv[0]);
+		return 2;
+	}
+	const std::string directory = argv[1];
+	const bool update = argc > 2 && std::strcmp(argv[2], "--update") == 0;
+
+	int failures = 0;
+	for (const auto &test : cases)
+	{
+		const std::string path = directory + "/" + test.name + ".rvgd";
+		const Signal output = render(test);
+
+		if (update)
+		{
+			const bool written = writeGoldenFile(path, output);
+			std::printf("%-24s %s\n", test.name, written ? "written" : "could not write");
+			failures += written ? 0 : 1;
+			continue;
+		}
+
+		// The same render twice must match too, or the golden comparison means nothing
+		const auto repeat = compareOutputs(output, render(test));
+		Signal golden;
+		if (!readGoldenFile(path, golden))
+		{
+			std::printf("%-24s missing %s\n", test.name, path.c_str());
+			++failures;
+			continue;
+		}
+		const auto difference = compareOutputs(golden, output);
+		if (difference.identical && repeat.identical)
+		{
+			std::printf("%-24s ok\n", test.name);
+			continue;
+		}
+		if (!repeat.identical)
+			std::printf("%-24s not deterministic (%.1f dB between two renders)\n", test.name, repeat.errorDb);
+		else
+			std::printf("%-24s differs: %.1f dB error, max %g\n", test.name, difference.errorDb, difference.maxAbs);
+		++failures;
+	}
+	return failures == 0 ? 0 : 1;
+}
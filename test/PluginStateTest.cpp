@@ -0,0 +1,145 @@
+/*
+  ==============================================================================
+
+Plugin state test: the binary state (PluginState.h) reads back what was
+written, skips what a later build may append, and turns down anything it
+can't parse as this layout (another version, cut short, not a state at all),
+so the processor falls back to the XML path instead.
+
+  ==============================================================================
+*/
+
+#include "PluginState.h"
+
+#include <cstdio>
+#include <vector>
+
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const char* what)
+{
+	std::printf("%-44s %s\n", what, condition ? "ok" : "FAILED");
+	if (!condition) ++failures;
+}
+
+PluginState example()
+{
+	PluginState state;
+	state.seed = 0x12345678;
+	for (int i = 0; i < numParams; ++i) state.values[i] = float(i + 1) / float(numParams + 1);
+	return state;
+}
+
+bool sameValues(const PluginState& a, const PluginState& b)
+{
+	for (int i = 0; i < numParams; ++i)
+	{
+		if (a.values[i] != b.values[i] || !b.found[i]) return false;
+	}
+	return a.seed == b.seed;
+}
+
+void setU16(std::vector<uint8_t>& bytes, size_t at, uint16_t value)
+{
+	bytes[at] = uint8_t(value);
+	bytes[at + 1] = uint8_t(value >> 8);
+}
+
+}  // namespace
+
+
+int main()
+{
+	const PluginState original = example();
+	std::vector<uint8_t> bytes;
+	original.write(bytes);
+
+	{
+		PluginState read;
+		check(PluginState::isBinary(bytes.data(), bytes.size()) && read.read(bytes.data(), bytes.size()) && sameValues(original, read),
+			"round trip");
+	}
+
+	// A later build under the same version: a longer header, longer entries and an unknown parameter
+	{
+		const size_t extraHeader = 8, extraEntry = 4;
+		const size_t count = size_t(numParams) + 1;
+		std::vector<uint8_t> extended(bytes.begin(), bytes.begin() + PluginState::headerSize);
+		extended.resize(PluginState::headerSize + extraHeader, 0xEE);
+		setU16(extended, 6, uint16_t(PluginState::headerSize + extraHeader));
+		setU16(extended, 12, uint16_t(count));
+		setU16(extended, 14, uint16_t(PluginState::entrySize + extraEntry));
+		for (size_t e = 0; e < count; ++e)
+		{
+			if (e < size_t(numParams))
+			{
+				const auto entry = bytes.begin() + PluginState::headerSize + e*PluginState::entrySize;
+				extended.insert(extended.end(), entry, entry + PluginState::entrySize);
+			}
+			else
+			{
+				extended.insert(extended.end(), PluginState::entrySize, 0xAB);  // hash of nothing we know
+			}
+			extended.insert(extended.end(), extraEntry, 0xEE);
+		}
+		PluginState read;
+		check(read.read(extended.data(), extended.size()) && sameValues(original, read), "appended fields and entries skipped");
+	}
+
+	// Only the parameters in the blob are set
+	{
+		std::vector<uint8_t> partial(bytes.begin(), bytes.begin() + PluginState::headerSize + PluginState::entrySize);
+		setU16(partial, 12, 1);
+		PluginState read;
+		const bool accepted = read.read(partial.data(), partial.size());
+		bool othersUnset = true;
+		for (int i = 1; i < numParams; ++i) othersUnset = othersUnset && !read.found[i];
+		check(accepted && read.found[0] && read.values[0] == original.values[0] && othersUnset, "missing parameters left alone");
+	}
+
+	for (const uint16_t version : { uint16_t(0), uint16_t(PluginState::version + 1), uint16_t(0xFFFF) })
+	{
+		auto other = bytes;
+		setU16(other, 4, version);
+		PluginState read;
+		char what[64];
+		std::snprintf(what, sizeof(what), "version %u rejected", unsigned(version));
+		check(!read.read(other.data(), other.size()), what);
+	}
+
+	{
+		bool allRejected = true;
+		for (size_t size = 0; size < bytes.size(); ++size)
+		{
+			PluginState read;
+			allRejected = allRejected && !read.read(bytes.data(), size);
+		}
+		check(allRejected, "every truncation rejected");
+	}
+
+	{
+		auto shortHeader = bytes;
+		setU16(shortHeader, 6, PluginState::headerSize - 1);
+		auto shortEntries = bytes;
+		setU16(shortEntries, 14, PluginState::entrySize - 1);
+		auto tooMany = bytes;
+		setU16(tooMany, 12, uint16_t(numParams + 1));
+		PluginState read;
+		check(!read.read(shortHeader.data(), shortHeader.size()) && !read.read(shortEntries.data(), shortEntries.size())
+			&& !read.read(tooMany.data(), tooMany.size()), "inconsistent sizes rejected");
+	}
+
+	{
+		const char xml[] = "<?xml version=\"1.0\"?><Parameters/>";
+		auto badMagic = bytes;
+		badMagic[0] ^= 0xFF;
+		PluginState read;
+		check(!PluginState::isBinary(xml, sizeof(xml)) && !read.read(xml, sizeof(xml)) && !read.read(badMagic.data(), badMagic.size()),
+			"not a binary state");
+	}
+
+	return failures == 0 ? 0 : 1;
+}
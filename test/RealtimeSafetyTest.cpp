@@ -0,0 +1,158 @@
+
+/*
+  ==============================================================================
+
+Real-time safety test: drives ReverbCore the way a host drives the plugin,
+for every bus layout, with randomized automation, block sizes, sample formats
+and sample-rate changes. Fails on any allocation, lock or page-level system
+call inside a processing call (RealtimeChecks.h).
+
+configure() allocates, so it runs outside the checked scope, like
+prepareToPlay. The first argument is the random seed (default 1).
+
+  ==============================================================================
+*/
+
+#include "ReverbCore.h"
+#include "RealtimeChecks.h"
+
+#if !REVERB_RT_CHECKS
+	#error "Needs REVERB_RT_CHECKS, see test/CMakeLists.txt"
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+
+namespace {
+
+struct TestLayout {
+	const char* name;
+	int numChannels;
+	int lfeChannel;
+	int ambisonicOrder;
+	ReverbCore::StereoMode stereoMode;
+};
+
+constexpr TestLayout layouts[] = {
+	{ "mono",        1, -1, -1, ReverbCore::StereoMode::stereo },
+	{ "stereo",      2, -1, -1, ReverbCore::StereoMode::stereo },
+	{ "binaural",    2, -1, -1, ReverbCore::StereoMode::binaural },
+	{ "true stereo", 2, -1, -1, ReverbCore::StereoMode::trueStereo },
+	{ "quad",        4, -1, -1, ReverbCore::StereoMode::stereo },
+	{ "5.1",         6,  3, -1, ReverbCore::StereoMode::stereo },
+	{ "7.1",         8,  3, -1, ReverbCore::StereoMode::stereo },
+	{ "7.1.4",      12,  3, -1, ReverbCore::StereoMode::stereo },
+	{ "ambisonic 1", 4, -1,  1, ReverbCore::StereoMode::stereo },
+	{ "ambisonic 3", 16, -1, 3, ReverbCore::StereoMode::stereo },
+};
+
+// The plugin's parameter ranges, in ReverbCore::Parameter order
+constexpr double parameterRanges[][2] = {
+	{ 10, 200 },   // size, ms
+	{ 0.2, 40 },   // decay, s
+	{ 0, 1 },      // dry
+	{ 0, 1 },      // diffuser
+	{ 0, 1 },      // early reflections
+	{ 0, 500 },    // pre-delay, ms
+	{ 0.05, 5 },   // modulation rate, Hz
+	{ 0, 5 },      // modulation depth, ms
+};
+
+constexpr double sampleRates[] = { 44100, 96000, 22050, 48000 };
+constexpr int maxBlockSize = 2048;
+constexpr double secondsPerRate = 0.25;
+
+}  // namespace
+
+
+int main(int argc, char** argv)
+{
+	RealtimeChecks::abortOnViolation.store(false);  // count them all, and fail at the end
+	const uint32_t seed = (argc > 1) ? uint32_t(std::strtoul(argv[1], nullptr, 10)) : 1;
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+	for (const auto &test : layouts)
+	{
+		ReverbCore::Layout layout;
+		layout.numChannels = test.numChannels;
+		layout.lfeChannel = test.lfeChannel;
+		layout.ambisonicOrder = test.ambisonicOrder;
+		layout.stereoMode = test.stereoMode;
+		ReverbCore core(layout);
+		core.setSeed(uint32_t(random()));
+
+		const int channels = core.getNumChannels();
+		std::vector<std::vector<float>> floats(static_cast<size_t>(channels), std::vector<float>(maxBlockSize));
+		std::vector<std::vector<double>> doubles(static_cast<size_t>(channels), std::vector<double>(maxBlockSize));
+		std::vector<float> interleavedFloats(static_cast<size_t>(channels * maxBlockSize));
+		std::vector<double> interleavedDoubles(static_cast<size_t>(channels * maxBlockSize));
+		std::vector<float*> floatPointers(static_cast<size_t>(channels));
+		std::vector<double*> doublePointers(static_cast<size_t>(channels));
+		for (int c = 0; c < channels; ++c)
+		{
+			floatPointers[size_t(c)] = floats[size_t(c)].data();
+			doublePointers[size_t(c)] = doubles[size_t(c)].data();
+		}
+
+		const uint32_t before = RealtimeChecks::violations.load();
+		for (double sampleRate : sampleRates)
+		{
+			core.configure(sampleRate);
+
+			for (int remaining = int(secondsPerRate * sampleRate); remaining > 0;)
+			{
+				// Mostly host-sized blocks, sometimes tiny ones (split blocks, sample-accurate automation)
+				const int numSamples = std::min(remaining, (unit(random) < 0.1) ? 1 + int(random() % 16) : 1 + int(random() % maxBlockSize));
+				const int format = int(random() % 4);
+				for (int c = 0; c < channels; ++c)
+				{
+					for (int i = 0; i < numSamples; ++i)
+					{
+						const double x = (unit(random) - 0.5) * 0.5;
+						floats[size_t(c)][size_t(i)] = float(x);
+						doubles[size_t(c)][size_t(i)] = x;
+						interleavedFloats[size_t(i * channels + c)] = float(x);
+						interleavedDoubles[size_t(i * channels + c)] = x;
+					}
+				}
+
+				REVERB_RT_SCOPE();
+				for (int p = 0; p < 8; ++p)
+				{
+					if (unit(random) < 0.3)
+					{
+						const double* range = parameterRanges[p];
+						core.setParameter(static_cast<ReverbCore::Parameter>(p), range[0] + (range[1] - range[0]) * unit(random));
+					}
+				}
+				if (unit(random) < 0.02)
+					core.retriggerModulation();
+
+				switch (format)
+				{
+					case 0:  core.process(floatPointers.data(), numSamples); break;
+					case 1:  core.process(doublePointers.data(), numSamples); break;
+					case 2:  core.processInterleaved(interleavedFloats.data(), numSamples); break;
+					default: core.processInterleaved(interleavedDoubles.data(), numSamples); break;
+				}
+				remaining -= numSamples;
+			}
+		}
+
+		const uint32_t found = RealtimeChecks::violations.load() - before;
+		std::printf("%-12s %s\n", test.name, (found == 0) ? "ok" : "real-time violations");
+	}
+
+	const uint32_t violations = RealtimeChecks::violations.load();
+	if (violations > 0)
+	{
+		std::printf("%u real-time violations, the first: %s (seed %u)\n", violations, RealtimeChecks::firstViolation.load(), seed);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,240 @@
+/*
+  ==============================================================================
+
+Shared engine test (SharedReverb.h), single-threaded so every host cycle is
+known. Members process in a fixed order, some of them skip cycles, and the
+return's wet is compared sample for sample against a reference engine run on
+the sum of the sends of each cycle, one block late. Dry is off, so the other
+members output nothing at all.
+
+  - members other than the return missing cycles
+  - the return leaving: the next member carries on with the wet
+  - the return bypassed (no longer processed): another member takes over,
+    and the old return is an ordinary member when it comes back
+
+  ==============================================================================
+*/
+
+#include "SharedReverb.h"
+
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+
+namespace {
+
+constexpr double sampleRate = 48000;
+constexpr int blockSize = 256;
+constexpr int numChannels = 2;
+constexpr int numCycles = 40;
+constexpr uint32_t seed = 4321;
+constexpr float earlyReflections = 0.5f;
+
+int failures = 0;
+
+void check(bool condition, const char* what)
+{
+	std::printf("%-44s %s\n", what, condition ? "ok" : "FAILED");
+	if (!condition) ++failures;
+}
+
+using Block = std::array<std::vector<double>, numChannels>;
+
+Block emptyBlock()
+{
+	Block block;
+	for (auto &channel : block) channel.assign(blockSize, 0.0);
+	return block;
+}
+
+// The plugin instances of one test. Each has its own noise, and keeps what it output per cycle.
+struct Instance {
+	std::unique_ptr<SharedReverbMember> member;
+	std::mt19937 random;
+	std::vector<Block> output;
+
+	Instance(const SharedReverbKey& key, uint32_t noiseSeed)
+		: member(SharedReverbRegistry::instance().join(key, seed)), random(noiseSeed), output(numCycles, emptyBlock())
+	{
+		if (member == nullptr) return;
+		member->setParameter(ParamId::dry, 0.0f);
+		member->setParameter(ParamId::wetReflections, earlyReflections);  // so there's wet within the first few blocks
+	}
+
+	// One block of noise through the member, added to the cycle's sum of sends
+	void process(int cycle, Block& sends)
+	{
+		std::uniform_real_distribution<double> noise(-0.5, 0.5);
+		Block block = emptyBlock();
+		for (int c = 0; c < numChannels; ++c)
+		{
+			for (int i = 0; i < blockSize; ++i)
+			{
+				block[c][i] = noise(random);
+				sends[c][i] += block[c][i];
+			}
+		}
+		std::array<double*, numChannels> pointers = { block[0].data(), block[1].data() };
+		member->process(pointers.data(), blockSize);
+		output[cycle] = block;
+	}
+};
+
+// The engine a group with this key runs, on its own
+struct Reference {
+	std::unique_ptr<ReverbEngine> engine = createReverbEngine(numChannels, -1);
+	std::vector<Block> wet = std::vector<Block>(numCycles, emptyBlock());
+
+	Reference()
+	{
+		engine->setSeed(seed);
+		engine->setDry(0);
+		engine->setEarlyReflections(earlyReflections);
+		engine->configure(sampleRate);
+	}
+
+	void process(int cycle, Block sends)
+	{
+		std::array<double*, numChannels> pointers = { sends[0].data(), sends[1].data() };
+		engine->process(pointers.data(), blockSize);
+		wet[cycle] = sends;
+	}
+};
+
+SharedReverbKey makeKey(int engineId)
+{
+	SharedReverbKey key;
+	key.engineId = engineId;
+	key.numHostChannels = numChannels;
+	key.sampleRate = sampleRate;
+	key.maxBlockSize = blockSize;
+	return key;
+}
+
+bool same(const Block& a, const Block& b)
+{
+	for (int c = 0; c < numChannels; ++c)
+	{
+		for (int i = 0; i < blockSize; ++i)
+		{
+			if (a[c][i] != b[c][i]) return false;
+		}
+	}
+	return true;
+}
+
+bool silent(const Block& block)
+{
+	return same(block, emptyBlock());
+}
+
+bool audible(const Block& block)
+{
+	double sum = 0;
+	for (const auto &channel : block)
+	{
+		for (double x : channel) sum += x*x;
+	}
+	return std::isfinite(sum) && sum > 1e-12;
+}
+
+// `source` outputs the wet of the cycle before in cycles [from, to), and is silent before that
+bool carriesWet(const Instance& source, const Reference& reference, int from, int to = numCycles)
+{
+	bool ok = true, heard = false;
+	for (int cycle = 0; cycle < to; ++cycle)
+	{
+		if (cycle < from)
+			ok = ok && silent(source.output[cycle]);
+		else
+			ok = ok && same(source.output[cycle], reference.wet[cycle - 1]);
+		heard = heard || audible(source.output[cycle]);
+	}
+	return ok && heard;
+}
+
+bool allSilent(const Instance& instance, int from = 0, int to = numCycles)
+{
+	bool ok = true;
+	for (int cycle = from; cycle < to; ++cycle) ok = ok && silent(instance.output[cycle]);
+	return ok;
+}
+
+
+void membersMissingCycles()
+{
+	const auto key = makeKey(1);
+	Instance a(key, 1), b(key, 2), c(key, 3);  // a joined first: the return
+	Reference reference;
+
+	for (int cycle = 0; cycle < numCycles; ++cycle)
+	{
+		Block sends = emptyBlock();
+		a.process(cycle, sends);
+		if (cycle < 8 || cycle >= 13) b.process(cycle, sends);
+		if (cycle != 20) c.process(cycle, sends);
+		reference.process(cycle, sends);
+	}
+
+	check(a.member->isReturn() && !b.member->isReturn() && !c.member->isReturn(), "first member is the return");
+	check(carriesWet(a, reference, 1), "return: sum of the cycle's sends");
+	check(allSilent(b) && allSilent(c), "others: nothing but their dry");
+}
+
+void returnLeaving()
+{
+	const auto key = makeKey(2);
+	auto a = std::make_unique<Instance>(key, 1);
+	Instance b(key, 2);
+	Reference reference;
+	constexpr int leaves = 15;
+
+	for (int cycle = 0; cycle < numCycles; ++cycle)
+	{
+		if (cycle == leaves) a->member.reset();
+		Block sends = emptyBlock();
+		if (cycle < leaves) a->process(cycle, sends);
+		b.process(cycle, sends);
+		reference.process(cycle, sends);
+	}
+
+	check(b.member->isReturn(), "return left: the other member takes over");
+	check(carriesWet(*a, reference, 1, leaves), "return until it leaves");
+	check(carriesWet(b, reference, leaves), "then the next one, from the next block");
+}
+
+void returnBypassed()
+{
+	const auto key = makeKey(3);
+	Instance a(key, 1), b(key, 2);
+	Reference reference;
+	constexpr int bypassed = 10, back = 25;
+
+	for (int cycle = 0; cycle < numCycles; ++cycle)
+	{
+		Block sends = emptyBlock();
+		b.process(cycle, sends);
+		if (cycle < bypassed || cycle >= back) a.process(cycle, sends);
+		reference.process(cycle, sends);
+	}
+
+	// b notices once a has missed more than idleGenerations cycles
+	const int takesOver = bypassed + int(SharedReverbGroup::idleGenerations);
+	check(b.member->isReturn() && !a.member->isReturn(), "return bypassed: another member takes over");
+	check(carriesWet(a, reference, 1, bypassed) && allSilent(a, back), "old return: silent when it comes back");
+	check(carriesWet(b, reference, takesOver), "new return: sum of the cycle's sends");
+}
+
+}  // namespace
+
+
+int main()
+{
+	membersMissingCycles();
+	returnLeaving();
+	returnBypassed();
+	return failures == 0 ? 0 : 1;
+}
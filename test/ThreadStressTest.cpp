@@ -0,0 +1,339 @@
+
+/*
+  ==============================================================================
+
+Thread stress test, for the thread-sanitizer build
+(-DREVERB_SANITIZER=thread): runs the plugin's threading without JUCE, as
+hard as it goes.
+
+  - two instances, each with an audio thread running a GovernedReverbEngine
+    under made-up CPU load, so the governor keeps stepping down and back up
+  - a message thread per instance: maintain() (builds and clears tiers),
+    engine rebuilds swapped in under a callback lock, serial and pipelined,
+    and offline on and off
+  - two parameter threads (host automation and UI) writing PendingParameters
+  - a shared engine group with four members on their own threads, free
+    running, with one member leaving and joining again now and then
+
+It runs for at least the given time, and then on until the governor, the
+rebuilds and the rejoins have each had a few goes (which takes much longer
+sanitized). Without a sanitizer it's still a smoke test: it fails if any output
+isn't finite, or if it never got that far. Under one, any report fails it
+(exit code 66).
+
+Usage: thread_stress_test [seconds] (default 2)
+
+  ==============================================================================
+*/
+
+#include "QualityGovernor.h"
+#include "SharedReverb.h"
+#include "ParameterEvents.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+
+namespace {
+
+constexpr double sampleRate = 48000;
+constexpr int blockSize = 256;
+constexpr int numEngineParams = static_cast<int>(ParamId::modDepth) + 1;
+
+// The plugin's ranges for size ... modDepth
+constexpr float parameterRanges[numEngineParams][2] = {
+	{ 10, 200 }, { 0.2f, 40 }, { 0, 1 }, { 0, 1 }, { 0, 1 }, { 0, 500 }, { 0.05f, 5 }, { 0, 5 },
+};
+
+std::atomic<bool> running{true};
+std::atomic<int> nonFinite{0};
+std::atomic<int> blocks{0}, tierSwitches{0}, rebuilds{0}, rejoins{0};  // to show it did something
+
+// It runs until each of those has happened this often, within the limit
+constexpr int minimumCount = 4;
+constexpr double maxSeconds = 120;
+
+void sleepFor(int microseconds) { std::this_thread::sleep_for(std::chrono::microseconds(microseconds)); }
+
+// Noise in, checked out
+struct Block {
+	std::array<std::vector<double>, 2> channels;
+	std::array<double*, 2> pointers{};
+	std::mt19937 random;
+
+	explicit Block(uint32_t seed) : random(seed)
+	{
+		for (int c = 0; c < 2; ++c)
+		{
+			channels[c].assign(blockSize, 0.0);
+			pointers[c] = channels[c].data();
+		}
+	}
+
+	void fill()
+	{
+		std::uniform_real_distribution<double> noise(-0.25, 0.25);
+		for (auto &channel : channels)
+			for (double &x : channel) x = noise(random);
+	}
+
+	void check()
+	{
+		for (const auto &channel : channels)
+			for (double x : channel)
+				if (!std::isfinite(x)) nonFinite.fetch_add(1);
+	}
+};
+
+float randomValue(std::mt19937& random, int id)
+{
+	std::uniform_real_distribution<float> unit(0, 1);
+	return parameterRanges[id][0] + (parameterRanges[id][1] - parameterRanges[id][0]) * unit(random);
+}
+
+
+// The processor's engine handling: parameters through PendingParameters, rebuilds swapped in under
+// the callback lock, maintain() on the message thread
+struct Instance {
+	std::mutex callbackLock;
+	std::unique_ptr<GovernedReverbEngine> engine;
+	PendingParameters parameters;
+	uint32_t seed;
+	bool offline = false;  // message thread
+
+	explicit Instance(uint32_t seed) : engine(build(seed, false, false)), seed(seed) {}
+
+	static std::unique_ptr<GovernedReverbEngine> build(uint32_t seed, bool pipelined, bool offline)
+	{
+		auto engine = createGovernedReverbEngine(2, -1);
+		engine->setSeed(seed);
+		engine->setOffline(offline);
+		engine->setPipelineBlockSize(pipelined ? blockSize : 0);
+		engine->configure(sampleRate);
+		return engine;
+	}
+
+	void apply(ParamId id, float value)
+	{
+		switch (id)
+		{
+			case ParamId::size:           engine->setRoomSize(value); break;
+			case ParamId::decay:          engine->setDecay(value); break;
+			case ParamId::dry:            engine->setDry(value); break;
+			case ParamId::diffuser:       engine->setDiffusionGain(value); break;
+			case ParamId::wetReflections: engine->setEarlyReflections(value); break;
+			case ParamId::preDelay:       engine->setPreDelay(value); break;
+			case ParamId::modRate:        engine->setModulationRate(value); break;
+			case ParamId::modDepth:       engine->setModulationDepth(value); break;
+			default: break;
+		}
+	}
+
+	void audioThread()
+	{
+		Block block(seed);
+		for (int count = 0; running.load(); ++count)
+		{
+			block.fill();
+			{
+				std::lock_guard<std::mutex> lock(callbackLock);
+				parameters.drain([this](ParamId id, float value) { apply(id, value); });
+				if (count % 97 == 0) engine->retriggerModulation();
+				engine->process(block.pointers.data(), blockSize);
+
+				// Overloaded for a while, then idle for a while: down through the tiers and back up
+				const bool overloaded = (count / 40) % 2 == 0;
+				const EngineTier tier = engine->getTier();
+				engine->reportLoad(overloaded ? 0.9f : 0.05f, overloaded ? 0.1 : 0.5);
+				if (engine->getTier() != tier) tierSwitches.fetch_add(1);
+			}
+			block.check();
+			blocks.fetch_add(1);
+			sleepFor(100);  // a callback period, shortened
+		}
+	}
+
+	void messageThread()
+	{
+		std::mt19937 random(seed + 1);
+		for (int count = 0; running.load(); ++count)
+		{
+			engine->maintain();
+			if (count % 200 == 199)
+			{
+				// handleAsyncUpdate: build, swap under the lock, free the old one here, push the values again
+				auto newEngine = build(seed, random() % 2 == 0, offline);
+				{
+					std::lock_guard<std::mutex> lock(callbackLock);
+					std::swap(engine, newEngine);
+				}
+				newEngine.reset();
+				rebuilds.fetch_add(1);
+				for (int i = 0; i < numEngineParams; ++i)
+					parameters.set(static_cast<ParamId>(i), randomValue(random, i));
+			}
+			if (count % 500 == 0 || count % 500 == 30)
+			{
+				offline = count % 500 == 0;  // a short bounce now and then
+				engine->setOffline(offline);
+			}
+			(void)engine->getTier();
+			(void)engine->getLatencySamples();
+			sleepFor(1000);
+		}
+	}
+};
+
+
+// A processor in shared mode: its member, swapped when it rejoins
+struct Member {
+	std::mutex callbackLock;
+	std::unique_ptr<SharedReverbMember> member;
+	PendingParameters parameters;
+	SharedReverbKey key;
+	uint32_t seed;
+
+	Member(const SharedReverbKey& key, uint32_t seed) : key(key), seed(seed)
+	{
+		member = SharedReverbRegistry::instance().join(key, seed);
+	}
+
+	void audioThread()
+	{
+		Block block(seed);
+		for (int count = 0; running.load(); ++count)
+		{
+			block.fill();
+			{
+				std::lock_guard<std::mutex> lock(callbackLock);
+				parameters.drain([this](ParamId id, float value) {
+					if (id == ParamId::modRate) member->setModulationRate(value);
+					else member->setParameter(id, value);
+				});
+				if (count % 89 == 0) member->retriggerModulation();
+				member->process(block.pointers.data(), blockSize);
+			}
+			block.check();
+			blocks.fetch_add(1);
+			sleepFor((count % 7 == 0) ? 300 : 100);  // hosts don't keep members in step
+		}
+	}
+
+	// Message thread: leave and join again
+	void rejoin()
+	{
+		std::unique_ptr<SharedReverbMember> old;
+		{
+			std::lock_guard<std::mutex> lock(callbackLock);
+			old = std::move(member);
+			member = nullptr;
+		}
+		old.reset();  // leaves before joining again, like prepareToPlay
+		auto joined = SharedReverbRegistry::instance().join(key, seed);
+		std::lock_guard<std::mutex> lock(callbackLock);
+		member = std::move(joined);
+		rejoins.fetch_add(1);
+	}
+};
+
+}  // namespace
+
+
+int main(int argc, char** argv)
+{
+	const double seconds = (argc > 1) ? std::atof(argv[1]) : 2.0;
+
+	// The tiers' level-match calibration runs once per process, and takes a while without
+	// optimisation: get it done before the clock starts. Offline builds the high tier, and
+	// missed deadlines step down through the rest.
+	{
+		auto engine = Instance::build(1, false, true);
+		engine->setOffline(false);
+		for (int t = 0; t < engineTierCount; ++t)
+		{
+			engine->reportLoad(2.0f, 0.01);
+			engine->maintain();
+		}
+	}
+
+	std::vector<std::unique_ptr<Instance>> instances;
+	for (uint32_t i = 0; i < 2; ++i)
+		instances.push_back(std::make_unique<Instance>(100 + i));
+
+	SharedReverbKey key;
+	key.engineId = 1;
+	key.sampleRate = sampleRate;
+	key.maxBlockSize = blockSize;
+	std::vector<std::unique_ptr<Member>> members;
+	for (uint32_t m = 0; m < 4; ++m)
+		members.push_back(std::make_unique<Member>(key, 200 + m));
+
+	std::vector<std::thread> threads;
+	for (auto &instance : instances)
+	{
+		threads.emplace_back([&] { instance->audioThread(); });
+		threads.emplace_back([&] { instance->messageThread(); });
+	}
+	for (auto &member : members)
+		threads.emplace_back([&] { member->audioThread(); });
+
+	// Host automation and UI
+	for (uint32_t p = 0; p < 2; ++p)
+	{
+		threads.emplace_back([&, p] {
+			std::mt19937 random(300 + p);
+			while (running.load())
+			{
+				const int id = int(random() % numEngineParams);
+				const float value = randomValue(random, id);
+				instances[random() % instances.size()]->parameters.set(static_cast<ParamId>(id), value);
+				auto &member = *members[random() % members.size()];
+				member.parameters.set(static_cast<ParamId>(id), value);
+				if (random() % 4 == 0) member.parameters.set(ParamId::sharedSend, float(random() % 100) / 100.0f);
+				sleepFor(200);
+			}
+		});
+	}
+
+	// Shared engine membership changes
+	threads.emplace_back([&] {
+		std::mt19937 random(400);
+		while (running.load())
+		{
+			sleepFor(50000);
+			members[random() % members.size()]->rejoin();
+		}
+	});
+
+	// At least `seconds`, and then until it's been through everything a few times: sanitized and
+	// unoptimised, an engine block can take a hundred times longer
+	const auto start = std::chrono::steady_clock::now();
+	auto elapsed = [&] { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); };
+	auto covered = [] { return tierSwitches.load() >= minimumCount && rebuilds.load() >= minimumCount && rejoins.load() >= minimumCount; };
+	while (elapsed() < maxSeconds && (elapsed() < seconds || !covered()))
+		sleepFor(10000);
+	running.store(false);
+	for (auto &thread : threads)
+		thread.join();
+
+	std::printf("%d blocks, %d tier switches, %d rebuilds, %d rejoins in %.1f s\n", blocks.load(), tierSwitches.load(), rebuilds.load(), rejoins.load(), elapsed());
+	if (nonFinite.load() > 0)
+	{
+		std::printf("%d non-finite output samples\n", nonFinite.load());
+		return 1;
+	}
+	if (!covered())
+	{
+		std::printf("didn't get through everything %d times in %.0f s\n", minimumCount, maxSeconds);
+		return 1;
+	}
+	std::printf("ok\n");
+	return 0;
+}